@@ -7,11 +7,13 @@
   : inc! dup @ 1 + swap ! ;
   : reset 0 s0! 0 s1! 0 s2! 0 s3! 0 s4! ;
   : write ( n -- )
-    0 [ &s0 inc! ] ;CASE
-    1 [ &s1 inc! ] ;CASE
-    2 [ &s2 inc! ] ;CASE
-    3 [ &s3 inc! ] ;CASE
-    4 [ &s4 inc! ] ;CASE
+    CASE
+      0 OF &s0 inc! ENDOF
+      1 OF &s1 inc! ENDOF
+      2 OF &s2 inc! ENDOF
+      3 OF &s3 inc! ENDOF
+      4 OF &s4 inc! ENDOF
+    ENDCASE
   ;
   : stars ( a -- ) ? 100 / [ "*" pr ] for cr ;
   : show s0 stars s1 stars s2 stars s3 stars s4 stars ;
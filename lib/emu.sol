@@ -2,6 +2,9 @@
   : query 11 io ;
   : title!       0 query ; # s --
   : show_cursor! 1 query ; # 0/1 --
-  : poll_count!  2 query ; # n --
+  : poll_count!  2 query ; # n -- ( 0: adaptive )
   : poll         3 query ; # --
-;
\ No newline at end of file
+  : frame_time   4 query ; # -- usec
+  : overruns     5 query ; # -- n
+  : speed        6 query ; # -- steps/msec
+;
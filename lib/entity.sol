@@ -11,14 +11,14 @@
   : dead!  2 cells + + no  swap b! ; # id es --
   ( ----- create entity table ----- )
   : entities ( size -- addr )
-    val: es  val: s
+    local: es  local: s
     dup s! 2 cells + allot es!
     s es size!
     0 es next!
     es ;
   ( ----- entity operation -----)
   : new ( es -- id not-full | full )
-    val: es  val: start  val: nx  val: id  val: max
+    local: es  local: start  local: nx  local: id  local: max
     : find
       nx dup id! 1 + max mod nx!
       id es dead? IF ( found )
@@ -53,7 +53,7 @@
   : get component_at @ ; # id cs -- v
   : set component_at ! ; # v id cs --
   : find ( v cs -- id yes | no )
-    val: cs  val: v  val: id
+    local: cs  local: v  local: id
     : loop
       id 0 < IF no RET END
       id cs get v = IF id yes RET END
@@ -70,23 +70,7 @@ include: "entity.sol"
 ;
 
 
-: put_text ( x y s -- )
-  val: x   val: y
-  val: ox  val: s
-  const: w 7
-  : right x w + x! ;
-  : next s 1 + s! ;
-  : newline ox x!  y 9 + y! ;
-  : draw ( i -- ) ppu:sprite:i! x y ppu:sprite:plot ;
-  : loop
-    s b@
-    dup 0  = IF drop RET END
-    dup 10 = IF drop newline next AGAIN END
-    dup 32 = IF drop right next AGAIN END
-    draw right next AGAIN ;
-  s! y! dup x! ox!
-  loop
-;
+: put_text ( x y s -- ) ppu:text ;
 
 
 : put_hex ( n x y -- )
@@ -125,7 +109,6 @@ include: "entity.sol"
   val: ts ( texts )
   val: params ( to pass to callback )
   val: ss ( show? )  val: qs ( callback )
-  val: ws ( width )
   val: ps ( pressed? )
   val: xs  val: ys
   val: dx  val: dy  ( draw origin )
@@ -136,16 +119,15 @@ include: "entity.sol"
   : x      i xs     ecs:get ;  : x!     i xs     ecs:set ;
   : y      i ys     ecs:get ;  : y!     i ys     ecs:set ;
   : q      i qs     ecs:get ;  : q!     i qs     ecs:set ;
-  : w      i ws     ecs:get ;  : w!     i ws     ecs:set ;
+  : w      t s:len ppu:spacing drop * ; ( follows the text advance )
   : show   i ss     ecs:get ;  : show!  i ss     ecs:set ;
   : new buttons ecs:components ;
   : init
     max ecs:entities buttons!
-    new ts! new params! new ws! new ss!  new qs!  new ps! new xs!  new ys! ;
+    new ts! new params! new ss!  new qs!  new ps! new xs!  new ys! ;
   : create ( param x y text q -- i )
     buttons ecs:new IF "too many text buttons!" panic END i!
     q! t! y! x! param!
-    t s:len put_text:w * w!
     yes show! ;
   : delete ( i -- ) buttons ecs:delete ;
   : clicked? mp IF no RET END p ;
@@ -12,6 +12,7 @@
   : switch!  13 query ; ( -- )
   : trans!   14 query ; ( addr -- )
   : copy!    15 query ; ( -- )
+  : map!      4 query ; ( addr -- ) ( 0 unmaps )
   : width    16 query ; ( -- w )
   : height   17 query ; ( -- h )
   ( ----- sprite ----- )
@@ -21,6 +22,7 @@
     : i!   20 query ; ( i -- )
     : load 21 query ; ( addr -- )
     : plot 22 query ; ( x y -- )
+    : draw_list 23 query ; ( addr n -- ) ( record: i x y palette flags )
     : bulk_load ( addr n -- )
       [ ( addr i -- addr )
         dup i! size * over + load
@@ -28,6 +30,23 @@
     : load_datafile ( addr -- )
       dup [ 4 + ] [ @ size / ] biq bulk_load ;
   ;
+  ( ----- text ----- )
+  : text     24 query ; ( x y s -- )
+  : spacing! 25 query ; ( advance line -- )
+  : spacing  26 query ; ( -- advance line )
+  ( ----- shape ----- )
+  : hline     30 query ; ( x y w -- )
+  : vline     31 query ; ( x y h -- )
+  : line      32 query ; ( x0 y0 x1 y1 -- )
+  : rect      33 query ; ( x y w h -- )
+  : fill_rect 34 query ; ( x y w h -- )
+  : blit      35 query ; ( addr x y w h key -- )
+  ( ----- tilemap ----- )
+  : tilemap
+    : set!    5 query ; ( addr cols rows -- )
+    : scroll! 6 query ; ( x y -- )
+    : draw    7 query ; ( -- )
+  ;
   ( ----- utils ----- )
   : 0clear
     0 palette!
@@ -14,62 +14,12 @@ include: "app.sol"
 
 
 
-: line ( x0 y0 x1 y1 -- )
-  # bresenham's algorithm
-  val: x0  val: y0
-  val: x1  val: y1
-  val: dx  val: dy
-  val: sx  val: sy
-  val: e1  val: e2
-  : CHECK
-    x0 x1 != IF RET END
-    y0 y1 != IF RET END
-    rdrop ( exit loop ) ;
-  : loop
-    x0 y0 plot
-    CHECK
-    e1 2 * e2!
-    e2 dy neg > IF
-      e1 dy - e1!
-      x0 sx + x0!
-    END
-    e2 dx < IF
-      e1 dx + e1!
-      y0 sy + y0!
-    END
-    AGAIN ;
-  y1! x1! y0! x0!
-  x1 x0 - abs dx!
-  y1 y0 - abs dy!
-  x1 x0 > IF 1 ELSE -1 END sx!
-  y1 y0 > IF 1 ELSE -1 END sy!
-  dx dy - e1!
-  loop
-;
+: line      ( x0 y0 x1 y1 -- ) ppu:line ;
+: rect      ( x y w h -- )     ppu:rect ;
+: fill_rect ( x y w h -- )     ppu:fill_rect ;
 
 
 
-: rect ( x y w h )
-  val: x  val: y  val: w  val: h
-  1 - h! 1 - w! y! x!
-  ( top    )  x     y      x w +  y     line
-  ( bottom )  x     y h +  x w +  y h + line
-  ( left   )  x     y      x      y h + line
-  ( right  )  x w + y      x w +  y h + line
-;
-
-
-: fill_rect ( x y w h )
-  val: x  val: y  val: w  val: h
-  h! w! y! x!
-  h [ y +
-    w [ ( y dx -- y )
-      x + over plot
-    ] for drop
-  ] for
-;
-
-
 : circle ( r x y -- )
   # bresenham's algorithm
   val: x   val: y   val: r
@@ -432,6 +432,31 @@ Private Code instZJMP(VM* vm) {
   return ARK_OK;
 }
 
+Private Code instJTBL(VM* vm) {
+  /* i -- ; jump to i-th addr of the table or next of the table
+          | JTBL
+    ip -> | n
+          | addr 0
+          | ...
+          | addr n-1
+  */
+  if (!has_ds_items(vm, 1)) Raise(DS_UNDERFLOW);
+  Code code = ark_get(vm, vm->ip); ExpectOK;
+  Cell n = vm->result;
+  if (n < 0) Raise(INVALID_INST);
+  Cell i = Pop();
+  Cell table = vm->ip + Cells(1);
+
+  Cell next = table + Cells(n);
+  if (i >= 0 && i < n) {
+    code = ark_get(vm, table + Cells(i)); ExpectOK;
+    next = vm->result;
+  }
+  if (!valid_addr(vm, next)) Raise(INVALID_ADDR);
+  vm->ip = next;
+  return ARK_OK;
+}
+
 
 // Memory
 
@@ -660,6 +685,71 @@ Private Code instRDROP(VM* vm) {
 }
 
 
+// Frame
+
+/*
+  ENTER n ( r: -- fp locals... )
+  saves fp and allots n cells (zero) of locals on return stack.
+
+          | return address
+          | saved fp
+    fp -> | local 0
+          | local 1
+          | ...
+    rp -> |
+
+  LEAVE drops the locals and restores fp.
+  LGET i / LSET i read/write local i at fp - i cells.
+*/
+
+Private Code instENTER(VM* vm) {
+  Code code = ark_get(vm, vm->ip); ExpectOK;
+  Cell n = vm->result;
+  vm->ip += Cells(1);
+  if (n < 0) Raise(INVALID_INST);
+  if (!has_rs_spaces(vm, n + 1)) Raise(RS_OVERFLOW);
+
+  RPush(vm->fp);
+  vm->fp = vm->rp;
+  for (Cell i = 0; i < n; i++) RPush(0);
+  return ARK_OK;
+}
+
+Private Code instLEAVE(VM* vm) {
+  if (vm->fp < vm->rp) Raise(RS_UNDERFLOW);
+  vm->rp = vm->fp;
+  if (!has_rs_items(vm, 1)) Raise(RS_UNDERFLOW);
+  vm->fp = RPop();
+  return ARK_OK;
+}
+
+Private Code local_addr(VM* vm) {
+  // read operand and set address of the local to vm->result
+  Code code = ark_get(vm, vm->ip); ExpectOK;
+  Cell addr = vm->fp - Cells(vm->result);
+  vm->ip += Cells(1);
+  if (addr <= vm->rp || addr > vm->fp) Raise(INVALID_ADDR);
+  vm->result = addr;
+  return ARK_OK;
+}
+
+Private Code instLGET(VM* vm) {
+  // -- v
+  if (!has_ds_spaces(vm, 1)) Raise(DS_OVERFLOW);
+  Code code = local_addr(vm); ExpectOK;
+  Push(Get(vm->result));
+  return ARK_OK;
+}
+
+Private Code instLSET(VM* vm) {
+  // v --
+  if (!has_ds_items(vm, 1)) Raise(DS_UNDERFLOW);
+  Code code = local_addr(vm); ExpectOK;
+  Set(vm->result, Pop());
+  return ARK_OK;
+}
+
+
 // Registers
 
 Private Code instGETSP(VM* vm) {
@@ -743,6 +833,13 @@ Private InstHandler InstTable[ARK_INSTRUCTION_COUNT] =
     instSETSP,
     instGETRP,
     instSETRP,
+    // Frame
+    instENTER,
+    instLEAVE,
+    instLGET,
+    instLSET,
+    // Jump table
+    instJTBL,
   };
 
 
@@ -818,6 +915,7 @@ Public VM* ark_new_vm(ArkamVMOptions* opts) {
   vm->sp = vm->rs - Cells(1);       // sp: 191
 
   vm->ip = 0;
+  vm->fp = 0;
 
   vm->io_handlers[ARK_DEVICE_SYS] = handleSYS;
 
@@ -122,6 +122,13 @@ enum {
       ARK_INST_SETSP,
       ARK_INST_GETRP,
       ARK_INST_SETRP,
+      // Frame
+      ARK_INST_ENTER,
+      ARK_INST_LEAVE,
+      ARK_INST_LGET,
+      ARK_INST_LSET,
+      // Jump table
+      ARK_INST_JTBL,
       ARK_INSTRUCTION_COUNT
 };
 
@@ -160,6 +167,7 @@ struct ArkamVM {
   Cell  ip;      // instruction pointer
   Cell  sp;      // data stack pointer
   Cell  rp;      // return stack pointer
+  Cell  fp;      // frame pointer (locals on return stack)
   Cell  result;
   Cell  err;
   ArkamDeviceHandler io_handlers[ARK_DEVICES_COUNT];
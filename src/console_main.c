@@ -2,21 +2,43 @@
 
 
 void usage() {
-  fprintf(stderr, "Usage: arkam IMAGE\n");
+  fprintf(stderr, "Usage: arkam [-p PROFILE -m SYMBOLS] IMAGE\n");
+  fprintf(stderr, "    -p PROFILE  Write call counts of words to PROFILE\n");
+  fprintf(stderr, "    -m SYMBOLS  Symbol file of the image (sol -m)\n");
   exit(1);
 }
 
 
 int main(int argc, char* argv[]) {
-  if (argc != 2) usage();
-
-  VM* vm = setup_arkam_vm(argv[1]);
+  char* profile = NULL;
+  char* symbols = NULL;
+  int c;
+  while ((c = getopt(argc, argv, "p:m:")) != -1) {
+    switch (c) {
+    case 'p': profile = optarg; break;
+    case 'm': symbols = optarg; break;
+    default:  usage();
+    }
+  }
+  if (argc - optind != 1) usage();
+  if (!profile != !symbols) usage();
+
+  VM* vm = setup_arkam_vm(argv[optind]);
+  if (profile) setup_profile(vm, symbols);
 
   Code code = ark_get(vm, ARK_ADDR_START);
   guard_err(vm, code);
   vm->ip = vm->result;
 
-  code = ark_run(vm);
+  if (profile) {
+    do {
+      profile_step(vm);
+      code = ark_step(vm);
+    } while (code == ARK_OK);
+    save_profile(profile);
+  } else {
+    code = ark_run(vm);
+  }
   guard_err(vm, code);
 
   code = ark_pop(vm);
@@ -5,7 +5,13 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <getopt.h>
+#include <stdatomic.h>
+#include <setjmp.h>
 #include <SDL2/SDL.h>
+#if defined(__x86_64__) || defined(__i386__)
+#define AVX2_PATH
+#include <immintrin.h>
+#endif
 
 typedef ArkamVM   VM;
 typedef ArkamCode Code;
@@ -15,9 +21,19 @@ Cell zoom = 2;
 #define WIDTH  256
 #define HEIGHT 192
 
-Cell poll_step = 5000;
+Cell poll_step = 0; // steps between polls, 0: adaptive
+int  use_avx2  = 0; // set by cpu at ppu creation
 Cell req_poll = 1;
 
+/* VM on its own thread, main thread presents and polls */
+int threaded = 1;
+
+/* Headless: no window, uncapped */
+int   headless = 0;
+Cell  max_frames = 0; // 0: until halt
+char* dump_prefix = NULL;
+int   print_checksum = 0;
+
 
 /* ===== Graceful Shutdown ===== */
 
@@ -34,25 +50,56 @@ static void quit(int code) {
 #define SPRITE_SIZE  64 /* 8x8 */
 #define SPRITE_NUM   256
 
+// draw list record: sprite x y palette flags
+#define DRAW_RECORD_CELLS 5
+#define FLIP_X 1
+#define FLIP_Y 2
+
+// text: glyph is sprite of char code
+#define TEXT_ADVANCE 7
+#define TEXT_LINE    9
+
 // 64 * 4 = 256 ( 1 byte )
 #define PALETTES 64
 #define COLORS   4
 #define Color (ppu->palette_i * COLORS + ppu->color)
 
+// dirty tracking granularity
+#define TILE 8
+
 typedef struct PPU {
   Cell  width;
   Cell  height;
   Cell  pixels;
   Byte* fg;
   Byte* bg;
+  Byte* own_bg; // bg while not mapped
+  Cell  mapped; // vm address of bg window, 0: not mapped
+  Byte* shown;  // fg at last upload
+  UCell shown_lut[PALETTES * COLORS];
   Cell* out;
+  /* Dirty tiles: may differ from shown */
+  Cell  tiles_w;
+  Cell  tiles_h;
+  Byte* fg_dirty;
+  Byte* bg_dirty;
+  int   req_full; // upload whole frame
   Cell  palette_i;
-  UCell palettes[PALETTES][COLORS];
+  UCell lut[PALETTES * COLORS]; // pixel -> ARGB (flattened palettes)
   Cell  color; // color number
   int   req_redraw;
   /* 8x8 Sprites */
   Cell sprites[SPRITE_NUM];
   Cell sprite_i;
+  /* Tilemap: sprite number bytes */
+  Cell tilemap;
+  Cell tilemap_cols;
+  Cell tilemap_rows;
+  Cell scroll_x;
+  Cell scroll_y;
+  /* Text */
+  Cell text_advance;
+  Cell text_line;
   /* SDL Specific */
   SDL_Window   *window;
   SDL_Renderer *renderer;
@@ -60,6 +107,15 @@ typedef struct PPU {
 } PPU;
 
 
+// pixels to render, dirty tiles are against shown
+typedef struct Frame {
+  Byte*  pixels;
+  UCell* lut;
+  Byte*  dirty;
+  Byte*  bg_dirty; // gets changed tiles, or NULL
+} Frame;
+
+
 PPU* ppu;
 
 
@@ -101,42 +157,373 @@ PPU* new_ppu(Cell width, Cell height) {
   if (!(ppu->fg  = calloc(sizeof(Byte), pixels))) die("Can't create ppu-fg");
   if (!(ppu->bg  = calloc(sizeof(Byte), pixels))) die("Can't create ppu-bg");
   if (!(ppu->out = calloc(sizeof(Cell), pixels))) die("Can't create ppu-out");
+  if (!(ppu->shown = calloc(sizeof(Byte), pixels))) die("Can't create ppu-shown");
+
+  ppu->tiles_w = (width  + TILE - 1) / TILE;
+  ppu->tiles_h = (height + TILE - 1) / TILE;
+  Cell tiles = ppu->tiles_w * ppu->tiles_h;
+  if (!(ppu->fg_dirty = calloc(sizeof(Byte), tiles))) die("Can't create ppu-fg_dirty");
+  if (!(ppu->bg_dirty = calloc(sizeof(Byte), tiles))) die("Can't create ppu-bg_dirty");
+  ppu->req_full = 1;
 
   ppu->palette_i = 0;
-  ppu->palettes[0][0] = 0xFF86A35A;
-  ppu->palettes[0][1] = 0xFF6F894F;
-  ppu->palettes[0][2] = 0xFF58754F;
-  ppu->palettes[0][3] = 0xFF32544F;
+  ppu->lut[0] = 0xFF86A35A;
+  ppu->lut[1] = 0xFF6F894F;
+  ppu->lut[2] = 0xFF58754F;
+  ppu->lut[3] = 0xFF32544F;
+
+  ppu->text_advance = TEXT_ADVANCE;
+  ppu->text_line    = TEXT_LINE;
 
-  init_sdl(ppu);
+#if defined(AVX2_PATH)
+  use_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+  if (!headless) init_sdl(ppu);
 
   return ppu;
 }
 
 
-void draw_ppu(PPU* ppu) {
-  // render on-screen buffer to out buffer
-  Cell pixels = ppu->pixels;
-  for (int i = 0; i < pixels; i++) {
-      Cell pixel = ppu->fg[i];
-      Cell palette_i = pixel / PALETTES;
-      Cell color_i = pixel % PALETTES;
-      Cell color = ppu->palettes[palette_i][color_i];
-      ppu->out[i] = color;
+#if defined(AVX2_PATH)
+__attribute__((target("avx2")))
+Cell expand_pixels_avx2(UCell* lut, Byte* src, Cell* dst, Cell n) {
+  // 8 pixels per gather, returns pixels done
+  Cell i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)(src + i)));
+    __m256i argb = _mm256_i32gather_epi32((const int*)lut, idx, 4);
+    _mm256_storeu_si256((__m256i*)(dst + i), argb);
   }
+  return i;
+}
+#endif
+
+void expand_pixels(UCell* lut, Byte* src, Cell* dst, Cell n) {
+  // pixel bytes to ARGB through lut
+#if defined(AVX2_PATH)
+  if (use_avx2) {
+    Cell done = expand_pixels_avx2(lut, src, dst, n);
+    src += done;
+    dst += done;
+    n   -= done;
+  }
+#endif
+  for (; n >= 4; n -= 4, src += 4, dst += 4) {
+    dst[0] = lut[src[0]];
+    dst[1] = lut[src[1]];
+    dst[2] = lut[src[2]];
+    dst[3] = lut[src[3]];
+  }
+  while (n-- > 0) *dst++ = lut[*src++];
 }
 
-void render_ppu(PPU* ppu) {
-  // render out buffer to window
-  draw_ppu(ppu);
+
+/* ----- dirty tiles ----- */
+
+void mark_dirty_rect(PPU* ppu, Cell x, Cell y, Cell w, Cell h) {
+  // mark bg tiles covering the rect (clipped)
+  int64_t x2 = (int64_t)x + w;
+  int64_t y2 = (int64_t)y + h;
+  if (x < 0) x = 0;
+  if (y < 0) y = 0;
+  if (x2 > ppu->width)  x2 = ppu->width;
+  if (y2 > ppu->height) y2 = ppu->height;
+  if (x >= x2 || y >= y2) return;
+  for (Cell ty = y / TILE; ty <= (y2 - 1) / TILE; ty++) {
+    Byte* row = ppu->bg_dirty + ty * ppu->tiles_w;
+    memset(row + x / TILE, 1, (x2 - 1) / TILE - x / TILE + 1);
+  }
+}
+
+void mark_dirty_all(PPU* ppu) {
+  memset(ppu->bg_dirty, 1, ppu->tiles_w * ppu->tiles_h);
+}
+
+#define MarkDirty(x, y) (ppu->bg_dirty[((y) / TILE) * ppu->tiles_w + (x) / TILE] = 1)
+
+
+int tile_changed(PPU* ppu, Frame* f, Cell tx, Cell ty) {
+  Cell i = ty * ppu->tiles_w + tx;
+  if (!f->dirty[i]) return 0;
+  f->dirty[i] = 0;
+  Cell x = tx * TILE;
+  Cell w = x + TILE > ppu->width ? ppu->width - x : TILE;
+  Cell y2 = ty * TILE + TILE > ppu->height ? ppu->height : ty * TILE + TILE;
+  for (Cell y = ty * TILE; y < y2; y++) {
+    Cell p = y * ppu->width + x;
+    if (memcmp(f->pixels + p, ppu->shown + p, w) != 0) {
+      // bg still holds what is shown now
+      if (f->bg_dirty) f->bg_dirty[i] = 1;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+void upload_rect(PPU* ppu, Frame* f, Cell x, Cell y, Cell w, Cell h) {
+  Cell width = ppu->width;
+  if (x + w > width) w = width - x;
+  if (y + h > ppu->height) h = ppu->height - y;
+  for (Cell row = y; row < y + h; row++) {
+    Cell p = row * width + x;
+    expand_pixels(f->lut, f->pixels + p, ppu->out + p, w);
+    memcpy(ppu->shown + p, f->pixels + p, w);
+  }
+  if (headless) return;
+  SDL_Rect rect = { x, y, w, h };
+  Cell bytes_of_line = width * sizeof(Cell);
+  SDL_UpdateTexture(ppu->texture, &rect, ppu->out + y * width + x, bytes_of_line);
+}
+
+
+void upload_dirty(PPU* ppu, Frame* f) {
+  // upload runs of changed tiles row by row
+  Byte changed[ppu->tiles_w + 1];
+  changed[ppu->tiles_w] = 0;
+  for (Cell ty = 0; ty < ppu->tiles_h; ty++) {
+    for (Cell tx = 0; tx < ppu->tiles_w; tx++) changed[tx] = tile_changed(ppu, f, tx, ty);
+    Cell tx = 0;
+    while (tx < ppu->tiles_w) {
+      if (!changed[tx]) { tx++; continue; }
+      Cell start = tx;
+      while (changed[tx]) tx++;
+      upload_rect(ppu, f, start * TILE, ty * TILE, (tx - start) * TILE, TILE);
+    }
+  }
+}
+
+
+void upload_frame(PPU* ppu, Frame* f) {
+  // changed part of frame to texture
+  Cell tiles = ppu->tiles_w * ppu->tiles_h;
+  if (!ppu->req_full && memcmp(f->lut, ppu->shown_lut, sizeof(ppu->shown_lut)) == 0) {
+    upload_dirty(ppu, f);
+    return;
+  }
+  expand_pixels(f->lut, f->pixels, ppu->out, ppu->pixels);
   Cell bytes_of_line = ppu->width * sizeof(Cell);
-  SDL_UpdateTexture(ppu->texture, NULL, ppu->out, bytes_of_line);
+  if (!headless) SDL_UpdateTexture(ppu->texture, NULL, ppu->out, bytes_of_line);
+  memcpy(ppu->shown, f->pixels, ppu->pixels);
+  memcpy(ppu->shown_lut, f->lut, sizeof(ppu->shown_lut));
+  memset(f->dirty, 0, tiles);
+  if (f->bg_dirty) memset(f->bg_dirty, 1, tiles); // bg is unknown against shown
+  ppu->req_full = 0;
+}
+
+
+void present_ppu(PPU* ppu) {
   SDL_RenderClear(ppu->renderer);
   SDL_RenderCopy(ppu->renderer, ppu->texture, NULL, NULL);
   SDL_RenderPresent(ppu->renderer);
 }
 
 
+void render_ppu(PPU* ppu) {
+  // render changed part of fg to window
+  Frame f = { ppu->fg, ppu->lut, ppu->fg_dirty, ppu->bg_dirty };
+  upload_frame(ppu, &f);
+  if (!headless) present_ppu(ppu);
+}
+
+
+/* ----- sprite blit ----- */
+
+#define BYTES_LO7 0x7F7F7F7F7F7F7F7FULL
+#define BYTES_HI  0x8080808080808080ULL
+#define BYTES_ONE 0x0101010101010101ULL
+
+static uint64_t blend_row(uint64_t dst, uint64_t src, Byte offset) {
+  // 8 pixels at once: non-zero src bytes + offset over dst
+  uint64_t nz   = (((src & BYTES_LO7) + BYTES_LO7) | src) & BYTES_HI;
+  uint64_t mask = (nz >> 7) * 0xFF;
+  uint64_t ofs  = BYTES_ONE * offset;
+  uint64_t sum  = ((src & BYTES_LO7) + (ofs & BYTES_LO7)) ^ ((src ^ ofs) & BYTES_HI);
+  return (dst & ~mask) | (sum & mask);
+}
+
+
+void blit_sprite(PPU* ppu, Byte* sprite, Cell ox, Cell oy, Cell palette, Cell flags) {
+  Cell w = ppu->width;
+  Cell h = ppu->height;
+  Byte offset = COLORS * palette;
+  if (ox >= 0 && oy >= 0 && ox + SPRITE_WIDTH <= w && oy + SPRITE_WIDTH <= h) {
+    // fully on-screen: no clipping
+    for (int dy = 0; dy < SPRITE_WIDTH; dy++) {
+      int sy = flags & FLIP_Y ? SPRITE_WIDTH - 1 - dy : dy;
+      uint64_t src, dst;
+      memcpy(&src, sprite + sy * SPRITE_WIDTH, 8);
+      if (flags & FLIP_X) src = __builtin_bswap64(src);
+      Byte* row = ppu->bg + (oy + dy) * w + ox;
+      memcpy(&dst, row, 8);
+      dst = blend_row(dst, src, offset);
+      memcpy(row, &dst, 8);
+    }
+  } else {
+    for (int dy = 0; dy < SPRITE_WIDTH; dy++) {
+      Cell y = oy + dy;
+      if (y < 0 || y >= h) continue;
+      int sy = flags & FLIP_Y ? SPRITE_WIDTH - 1 - dy : dy;
+      for (int dx = 0; dx < SPRITE_WIDTH; dx++) {
+        Cell x = ox + dx;
+        if (x < 0 || x >= w) continue;
+        int sx = flags & FLIP_X ? SPRITE_WIDTH - 1 - dx : dx;
+        Byte p = sprite[sy * SPRITE_WIDTH + sx];
+        if (p != 0) ppu->bg[y * w + x] = p + offset;
+      }
+    }
+  }
+  mark_dirty_rect(ppu, ox, oy, SPRITE_WIDTH, SPRITE_WIDTH);
+}
+
+
+
+/* ----- shapes ----- */
+
+void fill_rect(PPU* ppu, Cell x, Cell y, Cell w, Cell h, Byte c) {
+  // clipped, far edges in 64 bits for huge sizes
+  int64_t x2 = (int64_t)x + w;
+  int64_t y2 = (int64_t)y + h;
+  if (x < 0) x = 0;
+  if (y < 0) y = 0;
+  if (x2 > ppu->width)  x2 = ppu->width;
+  if (y2 > ppu->height) y2 = ppu->height;
+  if (x >= x2 || y >= y2) return;
+  for (Cell row = y; row < y2; row++) memset(ppu->bg + row * ppu->width + x, c, x2 - x);
+  mark_dirty_rect(ppu, x, y, x2 - x, y2 - y);
+}
+
+void draw_rect(PPU* ppu, Cell x, Cell y, Cell w, Cell h, Byte c) {
+  if (w < 1 || h < 1) return;
+  int64_t right  = (int64_t)x + w - 1;
+  int64_t bottom = (int64_t)y + h - 1;
+  fill_rect(ppu, x, y, w, 1, c);
+  if (bottom < ppu->height) fill_rect(ppu, x, bottom, w, 1, c);
+  fill_rect(ppu, x, y, 1, h, c);
+  if (right < ppu->width) fill_rect(ppu, right, y, 1, h, c);
+}
+
+void draw_line(PPU* ppu, Cell x0, Cell y0, Cell x1, Cell y1, Byte c) {
+  // bresenham's algorithm, both ends included
+  if (y0 == y1) {
+    Cell x = x0 < x1 ? x0 : x1;
+    fill_rect(ppu, x, y0, abs(x1 - x0) + 1, 1, c);
+    return;
+  }
+  if (x0 == x1) {
+    Cell y = y0 < y1 ? y0 : y1;
+    fill_rect(ppu, x0, y, 1, abs(y1 - y0) + 1, c);
+    return;
+  }
+  Cell dx = abs(x1 - x0);
+  Cell dy = abs(y1 - y0);
+  Cell sx = x1 > x0 ? 1 : -1;
+  Cell sy = y1 > y0 ? 1 : -1;
+  Cell e  = dx - dy;
+  Cell x = x0;
+  Cell y = y0;
+  while (1) {
+    if (x >= 0 && x < ppu->width && y >= 0 && y < ppu->height)
+      ppu->bg[y * ppu->width + x] = c;
+    if (x == x1 && y == y1) break;
+    Cell e2 = e * 2;
+    if (e2 > -dy) { e -= dy; x += sx; }
+    if (e2 <  dx) { e += dx; y += sy; }
+  }
+  mark_dirty_rect(ppu, x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, dx + 1, dy + 1);
+}
+
+void blit_rect(PPU* ppu, Byte* src, Cell x, Cell y, Cell w, Cell h, Cell key) {
+  // w*h bytes to bg, pixels of key are transparent (key -1: opaque)
+  Cell x1 = x < 0 ? 0 : x;
+  Cell y1 = y < 0 ? 0 : y;
+  int64_t x2 = (int64_t)x + w;
+  int64_t y2 = (int64_t)y + h;
+  if (x2 > ppu->width)  x2 = ppu->width;
+  if (y2 > ppu->height) y2 = ppu->height;
+  if (x1 >= x2 || y1 >= y2) return;
+  Cell n = x2 - x1;
+  for (Cell row = y1; row < y2; row++) {
+    Byte* s = src + ((int64_t)row - y) * w + ((int64_t)x1 - x);
+    Byte* d = ppu->bg + row * ppu->width + x1;
+    if (key < 0) {
+      memcpy(d, s, n);
+    } else {
+      for (Cell i = 0; i < n; i++) if (s[i] != key) d[i] = s[i];
+    }
+  }
+  mark_dirty_rect(ppu, x1, y1, n, y2 - y1);
+}
+
+
+
+/* ----- text ----- */
+
+Code draw_text(VM* vm, PPU* ppu, Cell x, Cell y, Cell s) {
+  // NUL-terminated string, \n: newline, space: no glyph
+  Cell ox = x;
+  for (;; s++) {
+    if (!ark_valid_addr(vm, s)) Raise(INVALID_ADDR);
+    Byte c = vm->mem[s];
+    if (c == 0) return ARK_OK;
+    if (c == '\n') { x = ox; y += ppu->text_line; continue; }
+    Cell addr = ppu->sprites[c];
+    if (c != ' ' && addr != 0)
+      blit_sprite(ppu, vm->mem + addr, x, y, ppu->palette_i, 0);
+    x += ppu->text_advance;
+  }
+}
+
+
+
+/* ----- tilemap ----- */
+
+static Cell wrap(Cell n, Cell m) {
+  n %= m;
+  return n < 0 ? n + m : n;
+}
+
+void draw_tilemap(VM* vm, PPU* ppu) {
+  // fill bg with tiles from scroll position, wrapping around the map
+  Byte* map = vm->mem + ppu->tilemap;
+  Cell map_w = ppu->tilemap_cols * SPRITE_WIDTH;
+  Cell map_h = ppu->tilemap_rows * SPRITE_WIDTH;
+  Byte offset = COLORS * ppu->palette_i;
+  for (Cell y = 0; y < ppu->height; y++) {
+    Cell my = wrap(y + ppu->scroll_y, map_h);
+    Byte* tiles = map + (my / SPRITE_WIDTH) * ppu->tilemap_cols;
+    Cell py = my % SPRITE_WIDTH;
+    Byte* dst = ppu->bg + y * ppu->width;
+    Cell mx = wrap(ppu->scroll_x, map_w);
+    Cell x = 0;
+    while (x < ppu->width) {
+      Cell px = mx % SPRITE_WIDTH;
+      Cell n = SPRITE_WIDTH - px;
+      if (n > ppu->width - x) n = ppu->width - x;
+      Cell addr = ppu->sprites[tiles[mx / SPRITE_WIDTH]];
+      if (addr == 0) {
+        memset(dst + x, offset, n); // null sprite
+      } else {
+        Byte* src = vm->mem + addr + py * SPRITE_WIDTH + px;
+        for (Cell i = 0; i < n; i++) dst[x + i] = src[i] + offset;
+      }
+      x += n;
+      mx += n;
+      if (mx >= map_w) mx = 0;
+    }
+  }
+  mark_dirty_all(ppu);
+}
+
+
+
+int valid_range(VM* vm, Cell a, int64_t len) {
+  // [a, a+len) in memory, len is computed by callers in 64 bits
+  return len > 0 && ark_valid_addr(vm, a)
+    && (int64_t)a + len <= (int64_t)vm->cells * (int64_t)sizeof(Cell);
+}
+
 Code handlePPU(VM* vm, Cell op) {
   switch (op) {
   case 0: /* set palette color ( color i -- ) */
@@ -146,7 +533,7 @@ Code handlePPU(VM* vm, Cell op) {
       Cell c = Pop();
       if (i < 0 || i >= COLORS) die("Invalid color number %d", i);
       UCell color = 0xFF000000 | c;
-      ppu->palettes[ppu->palette_i][i] = color;
+      ppu->lut[ppu->palette_i * COLORS + i] = color;
       return ARK_OK;
     }
 
@@ -175,12 +562,63 @@ Code handlePPU(VM* vm, Cell op) {
       return ARK_OK;
     }
 
+  case 4: /* map bg ( addr -- ) 0: unmap */
+    {
+      if (!ark_has_ds_items(vm, 1)) Raise(DS_UNDERFLOW);
+      Cell a = Pop();
+      if (a == 0) {
+        if (!ppu->mapped) return ARK_OK;
+        memcpy(ppu->own_bg, ppu->bg, ppu->pixels);
+        ppu->bg = ppu->own_bg;
+        ppu->mapped = 0;
+        mark_dirty_all(ppu);
+        return ARK_OK;
+      }
+      if (!(ark_valid_addr(vm, a) && ark_valid_addr(vm, a + ppu->pixels - 1)))
+        Raise(INVALID_ADDR);
+      if (!ppu->mapped) ppu->own_bg = ppu->bg;
+      ppu->bg = vm->mem + a;
+      ppu->mapped = a;
+      return ARK_OK;
+    }
+
+  case 5: /* set tilemap ( addr cols rows -- ) */
+    {
+      if (!ark_has_ds_items(vm, 3)) Raise(DS_UNDERFLOW);
+      Cell rows = Pop();
+      Cell cols = Pop();
+      Cell a    = Pop();
+      if (a == 0) { ppu->tilemap = 0; return ARK_OK; }
+      if (cols < 1 || rows < 1) die("Invalid tilemap size: %dx%d", cols, rows);
+      if (!valid_range(vm, a, (int64_t)cols * rows)) Raise(INVALID_ADDR);
+      ppu->tilemap = a;
+      ppu->tilemap_cols = cols;
+      ppu->tilemap_rows = rows;
+      return ARK_OK;
+    }
+
+  case 6: /* set scroll ( x y -- ) */
+    {
+      if (!ark_has_ds_items(vm, 2)) Raise(DS_UNDERFLOW);
+      ppu->scroll_y = Pop();
+      ppu->scroll_x = Pop();
+      return ARK_OK;
+    }
+
+  case 7: /* draw tilemap ( -- ) */
+    {
+      if (ppu->tilemap == 0) return ARK_OK;
+      draw_tilemap(vm, ppu);
+      return ARK_OK;
+    }
+
   case 10: /* clear */
     {
       Cell pixels = ppu->pixels;
       for (int i = 0; i < pixels; i++) {
         ppu->bg[i] = Color;
       }
+      mark_dirty_all(ppu);
       return ARK_OK;
     }
 
@@ -192,6 +630,7 @@ Code handlePPU(VM* vm, Cell op) {
       if (x < 0 || x >= ppu->width)  die("Invalid position x: %d", x);
       if (y < 0 || y >= ppu->height) die("Invalid position y: %d", y);
       ppu->bg[y*ppu->width + x] = Color;
+      MarkDirty(x, y);
       return ARK_OK;
     }
 
@@ -201,14 +640,25 @@ Code handlePPU(VM* vm, Cell op) {
       Cell i = Pop();
       if (i < 0 || i >= ppu->pixels)  die("Invalid index i: %d", i);
       ppu->bg[i] = Color;
-      return ARK_OK;      
+      MarkDirty(i % ppu->width, i / ppu->width);
+      return ARK_OK;
     }
 
   case 13: /* switch */
     {
+      if (ppu->mapped) {
+        // window is written by b! etc. without tracking
+        memcpy(ppu->fg, ppu->bg, ppu->pixels);
+        memset(ppu->fg_dirty, 1, ppu->tiles_w * ppu->tiles_h);
+        ppu->req_redraw = 1;
+        return ARK_OK;
+      }
       Byte* tmp = ppu->fg;
       ppu->fg = ppu->bg;
       ppu->bg = tmp;
+      tmp = ppu->fg_dirty;
+      ppu->fg_dirty = ppu->bg_dirty;
+      ppu->bg_dirty = tmp;
       ppu->req_redraw = 1;
       return ARK_OK;
     }
@@ -221,13 +671,15 @@ Code handlePPU(VM* vm, Cell op) {
       Cell end   = start+pixels - 1;
       if (!(ark_valid_addr(vm, start) && ark_valid_addr(vm, end)))
         Raise(INVALID_ADDR);
-      memcpy(ppu->bg, vm->mem + start, pixels);
+      memmove(ppu->bg, vm->mem + start, pixels);
+      mark_dirty_all(ppu);
       return ARK_OK;
     }
 
   case 15: /* copy ( -- ) copy fg to bg */
     {
       memcpy(ppu->bg, ppu->fg, ppu->pixels);
+      memcpy(ppu->bg_dirty, ppu->fg_dirty, ppu->tiles_w * ppu->tiles_h);
       return ARK_OK;
     }
 
@@ -271,24 +723,126 @@ Code handlePPU(VM* vm, Cell op) {
       Cell ox = Pop();
       Cell addr = ppu->sprites[ppu->sprite_i];
       if (addr == 0) return ARK_OK; // ignore null sprite
-      Cell w = ppu->width;
-      Cell h = ppu->height;
-      Byte* sprite = vm->mem + addr;
-      int i = 0;
-      for (int dy = 0; dy < SPRITE_WIDTH; dy++) {
-        for (int dx = 0; dx < SPRITE_WIDTH; dx++) {
-          Cell x = ox + dx;
-          Cell y = oy + dy;
-          if (x >= 0 && x < w && y >= 0 && y < h) {
-            Cell bi = y * w + x;
-            if (sprite[i] != 0) ppu->bg[bi] = sprite[i] + (COLORS * ppu->palette_i);
-          }
-          i++;
-        }
+      blit_sprite(ppu, vm->mem + addr, ox, oy, ppu->palette_i, 0);
+      return ARK_OK;
+    }
+
+  case 23: /* draw sprite list ( addr n -- ) */
+    {
+      if (!ark_has_ds_items(vm, 2)) Raise(DS_UNDERFLOW);
+      Cell n = Pop();
+      Cell start = Pop();
+      if (n < 0) die("Invalid sprite list size: %d", n);
+      if (n == 0) return ARK_OK;
+      if (!valid_range(vm, start, (int64_t)n * DRAW_RECORD_CELLS * (int64_t)sizeof(Cell)))
+        Raise(INVALID_ADDR);
+      Cell* rec = (Cell*)(vm->mem + start);
+      for (Cell i = 0; i < n; i++, rec += DRAW_RECORD_CELLS) {
+        Cell sprite_i = rec[0];
+        Cell palette  = rec[3];
+        if (sprite_i < 0 || sprite_i >= SPRITE_NUM) die("Invalid sprite number: %d", sprite_i);
+        if (palette < 0 || palette >= PALETTES) die("Invalid palette number: %d", palette);
+        Cell addr = ppu->sprites[sprite_i];
+        if (addr == 0) continue; // ignore null sprite
+        blit_sprite(ppu, vm->mem + addr, rec[1], rec[2], palette, rec[4]);
       }
       return ARK_OK;
     }
-    
+
+  case 24: /* text ( x y s -- ) */
+    {
+      if (!ark_has_ds_items(vm, 3)) Raise(DS_UNDERFLOW);
+      Cell s = Pop();
+      Cell y = Pop();
+      Cell x = Pop();
+      return draw_text(vm, ppu, x, y, s);
+    }
+
+  case 25: /* set text spacing ( advance line -- ) */
+    {
+      if (!ark_has_ds_items(vm, 2)) Raise(DS_UNDERFLOW);
+      ppu->text_line    = Pop();
+      ppu->text_advance = Pop();
+      return ARK_OK;
+    }
+
+  case 26: /* text spacing ( -- advance line ) */
+    {
+      if (!ark_has_ds_spaces(vm, 2)) Raise(DS_OVERFLOW);
+      Push(ppu->text_advance);
+      Push(ppu->text_line);
+      return ARK_OK;
+    }
+
+  case 30: /* hline ( x y w -- ) */
+    {
+      if (!ark_has_ds_items(vm, 3)) Raise(DS_UNDERFLOW);
+      Cell w = Pop();
+      Cell y = Pop();
+      Cell x = Pop();
+      fill_rect(ppu, x, y, w, 1, Color);
+      return ARK_OK;
+    }
+
+  case 31: /* vline ( x y h -- ) */
+    {
+      if (!ark_has_ds_items(vm, 3)) Raise(DS_UNDERFLOW);
+      Cell h = Pop();
+      Cell y = Pop();
+      Cell x = Pop();
+      fill_rect(ppu, x, y, 1, h, Color);
+      return ARK_OK;
+    }
+
+  case 32: /* line ( x0 y0 x1 y1 -- ) */
+    {
+      if (!ark_has_ds_items(vm, 4)) Raise(DS_UNDERFLOW);
+      Cell y1 = Pop();
+      Cell x1 = Pop();
+      Cell y0 = Pop();
+      Cell x0 = Pop();
+      draw_line(ppu, x0, y0, x1, y1, Color);
+      return ARK_OK;
+    }
+
+  case 33: /* rect ( x y w h -- ) */
+    {
+      if (!ark_has_ds_items(vm, 4)) Raise(DS_UNDERFLOW);
+      Cell h = Pop();
+      Cell w = Pop();
+      Cell y = Pop();
+      Cell x = Pop();
+      draw_rect(ppu, x, y, w, h, Color);
+      return ARK_OK;
+    }
+
+  case 34: /* fill rect ( x y w h -- ) */
+    {
+      if (!ark_has_ds_items(vm, 4)) Raise(DS_UNDERFLOW);
+      Cell h = Pop();
+      Cell w = Pop();
+      Cell y = Pop();
+      Cell x = Pop();
+      fill_rect(ppu, x, y, w, h, Color);
+      return ARK_OK;
+    }
+
+  case 35: /* blit ( addr x y w h key -- ) */
+    {
+      if (!ark_has_ds_items(vm, 6)) Raise(DS_UNDERFLOW);
+      Cell key = Pop();
+      Cell h = Pop();
+      Cell w = Pop();
+      Cell y = Pop();
+      Cell x = Pop();
+      Cell a = Pop();
+      if (w < 0 || h < 0) die("Invalid blit size: %dx%d", w, h);
+      if (w == 0 || h == 0) return ARK_OK;
+      if (!valid_range(vm, a, (int64_t)w * h)) Raise(INVALID_ADDR);
+      blit_rect(ppu, vm->mem + a, x, y, w, h, key);
+      return ARK_OK;
+    }
+
   default: Raise(IO_UNKNOWN_OP);
   }
 }
@@ -409,44 +963,167 @@ void dbg_draw_envs(PPU* ppu) {
   dbg_draw_env(ppu, fm_env_table_eu, 120, 8,  100, 48);
   dbg_draw_env(ppu, fm_env_table_ld, 8,   96, 100, 48);
   dbg_draw_env(ppu, fm_env_table_lu, 120, 96, 100, 48);  
+  ppu->req_full = 1; // drawn to fg directly
 }
 
 
 void setup_audio(VM* vm) {
+  if (headless) {
+    // synth runs on dummy device without video
+    SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+    if (SDL_Init(SDL_INIT_AUDIO) != 0)
+      die("Can't initialize SDL audio: %s", SDL_GetError());
+  }
   setup_fmsynth(vm);
   vm->io_handlers[ARK_DEVICE_AUDIO] = handleFMSYNTH;
 }
 
 
+/* ===== Frame Pacing ===== */
+
+#define FPS 60
+#define POLL_MSEC 1 // adaptive: steps between polls take this
+#define MIN_BUDGET 1000
+#define MAX_BUDGET 1000000
+
+typedef struct Pacer {
+  Uint64 freq;
+  Uint64 period;   // counts per frame
+  Uint64 start;    // of current frame
+  Uint64 deadline;
+  double steps_per_msec;
+  Cell   polls;    // requested in current frame
+  Cell   frame_usec;
+  Cell   overruns;
+} Pacer;
+
+Pacer pacer;
+
+
+Uint64 now() { return SDL_GetPerformanceCounter(); }
+
+void init_pacer() {
+  pacer.freq     = SDL_GetPerformanceFrequency();
+  pacer.period   = pacer.freq / FPS;
+  pacer.start    = now();
+  pacer.deadline = pacer.start + pacer.period;
+  pacer.steps_per_msec = 10000;
+}
+
+Cell step_budget() {
+  if (poll_step) return poll_step;
+  double b = pacer.steps_per_msec * POLL_MSEC;
+  return b < MIN_BUDGET ? MIN_BUDGET : (b > MAX_BUDGET ? MAX_BUDGET : b);
+}
+
+void measure_steps(Cell steps, Uint64 since) {
+  Uint64 elapsed = now() - since;
+  if (steps < 100 || elapsed == 0) return; // too short to measure
+  double rate = steps / ((double)elapsed * 1000 / pacer.freq);
+  pacer.steps_per_msec = pacer.steps_per_msec * 0.75 + rate * 0.25;
+}
+
+Cell msec_to_deadline() {
+  Uint64 t = now();
+  return t >= pacer.deadline ? 0 : (pacer.deadline - t) * 1000 / pacer.freq;
+}
+
+void next_frame(Uint64 start, Uint64 deadline) {
+  pacer.start    = start;
+  pacer.deadline = deadline;
+  pacer.polls    = 0;
+}
+
+void end_frame() {
+  // on switch: count, then sleep to deadline
+  Uint64 t = now();
+  pacer.frame_usec = (t - pacer.start) * 1000000 / pacer.freq;
+  if (t > pacer.deadline) pacer.overruns++;
+  if (headless || t >= pacer.deadline) { next_frame(t, t + pacer.period); return; }
+  SDL_Delay(msec_to_deadline());
+  next_frame(now(), pacer.deadline + pacer.period);
+}
+
+void roll_frame() {
+  // app runs without switch: frame passes without sleep
+  Uint64 t = now();
+  if (t >= pacer.deadline) next_frame(t, t + pacer.period);
+}
+
+int idle_poll() {
+  // polled again in same frame without switch: waiting for input
+  return ++pacer.polls > 1;
+}
+
+
+
 /* ===== EMU ===== */
 
+// window operations from vm thread are done by main thread
+Uint32 emu_event;
+enum { EMU_TITLE, EMU_CURSOR };
+
+void request_emu(int code, void* data) {
+  SDL_Event ev;
+  SDL_zero(ev);
+  ev.type = emu_event;
+  ev.user.code = code;
+  ev.user.data1 = data;
+  if (SDL_PushEvent(&ev) < 0) die("Can't push event: %s", SDL_GetError());
+}
+
+void handle_emu_event(SDL_Event* ev) {
+  switch (ev->user.code) {
+  case EMU_TITLE:
+    SDL_SetWindowTitle(ppu->window, ev->user.data1);
+    free(ev->user.data1);
+    return;
+  case EMU_CURSOR:
+    SDL_ShowCursor(ev->user.data1 ? SDL_ENABLE : SDL_DISABLE);
+    return;
+  }
+}
+
 Code handleEMU(VM* vm, Cell op) {
   switch (op) {
   case 0: /* set title ( s -- ) */
     {
       if (!ark_has_ds_items(vm, 1)) Raise(DS_UNDERFLOW);
       Cell s; PopValid(&s);
-      SDL_SetWindowTitle(ppu->window, (char*)(vm->mem + s));
+      char* title = (char*)(vm->mem + s);
+      if (headless) return ARK_OK;
+      if (threaded) {
+        char* copy = strdup(title);
+        if (!copy) die("Can't copy title");
+        request_emu(EMU_TITLE, copy);
+      } else {
+        SDL_SetWindowTitle(ppu->window, title);
+      }
       return ARK_OK;
     }
   case 1: /* show/hide cursor ( n -- ) */
     {
       if (!ark_has_ds_items(vm, 1)) Raise(DS_UNDERFLOW);
       Cell n = Pop();
+      if (n != 0 && n != -1) die("Unknown cursor state: %d", n);
+      if (headless) return ARK_OK;
+      if (threaded) {
+        request_emu(EMU_CURSOR, n ? (void*)1 : NULL);
+        return ARK_OK;
+      }
       switch (n) {
       case 0: /* hide */
         SDL_ShowCursor(SDL_DISABLE); break;
       case -1: /* show */
         SDL_ShowCursor(SDL_ENABLE); break;
-      default: die("Unknown cursor state: %d", n);
       }
       return ARK_OK;
     }
-  case 2: /* poll_step ( n -- ) */
+  case 2: /* poll_step ( n -- ) 0: adaptive */
     {
       if (!ark_has_ds_items(vm, 1)) Raise(DS_UNDERFLOW);
       Cell n = Pop();
-      if (n < 1) die("Invalid poll_step: %d", n);
+      if (n < 0) die("Invalid poll_step: %d", n);
       poll_step = n;
       return ARK_OK;
     }
@@ -455,82 +1132,388 @@ Code handleEMU(VM* vm, Cell op) {
       req_poll = 1;
       return ARK_OK;
     }
+  case 4: /* frame time ( -- usec ) */
+    {
+      if (!ark_has_ds_spaces(vm, 1)) Raise(DS_OVERFLOW);
+      Push(pacer.frame_usec);
+      return ARK_OK;
+    }
+  case 5: /* overruns ( -- n ) */
+    {
+      if (!ark_has_ds_spaces(vm, 1)) Raise(DS_OVERFLOW);
+      Push(pacer.overruns);
+      return ARK_OK;
+    }
+  case 6: /* steps per msec ( -- n ) */
+    {
+      if (!ark_has_ds_spaces(vm, 1)) Raise(DS_OVERFLOW);
+      Push(pacer.steps_per_msec);
+      return ARK_OK;
+    }
   default: Raise(IO_UNKNOWN_OP);
   }
 }
 
 void setup_emu(VM* vm) {
+  if (threaded) {
+    emu_event = SDL_RegisterEvents(1);
+    if (emu_event == (Uint32)-1) die("Can't register event");
+  }
   vm->io_handlers[ARK_DEVICE_EMU] = handleEMU;
 }
 
 
+/* ===== Headless ===== */
+
+void dump_frame(PPU* ppu, Cell frame) {
+  // out buffer to PREFIX000000.ppm
+  char name[1024];
+  snprintf(name, sizeof(name), "%s%06d.ppm", dump_prefix, frame);
+  FILE* f = fopen(name, "wb");
+  if (!f) die("Can't open %s: %s", name, strerror(errno));
+  fprintf(f, "P6\n%d %d\n255\n", ppu->width, ppu->height);
+  for (Cell i = 0; i < ppu->pixels; i++) {
+    UCell c = ppu->out[i];
+    Byte rgb[3] = { c >> 16, c >> 8, c };
+    fwrite(rgb, 1, 3, f);
+  }
+  fclose(f);
+}
+
+
+UCell frame_checksum(PPU* ppu) {
+  // FNV-1a of RGB bytes
+  UCell h = 2166136261u;
+  for (Cell i = 0; i < ppu->pixels; i++) {
+    UCell c = ppu->out[i];
+    h = (h ^ ((c >> 16) & 0xFF)) * 16777619u;
+    h = (h ^ ((c >> 8)  & 0xFF)) * 16777619u;
+    h = (h ^ (c & 0xFF))         * 16777619u;
+  }
+  return h;
+}
+
+
+Code run_headless(VM* vm) {
+  Code code = ARK_OK;
+  Cell frames = 0;
+  Uint64 start = SDL_GetPerformanceCounter();
+  init_pacer();
+
+  while (max_frames == 0 || frames < max_frames) {
+    code = ark_step(vm);
+    if (code != ARK_OK) break;
+    if (!ppu->req_redraw) continue;
+    render_ppu(ppu);
+    ppu->req_redraw = 0;
+    end_frame();
+    if (dump_prefix) dump_frame(ppu, frames);
+    if (print_checksum) fprintf(stderr, "frame %d %08x\n", frames, frame_checksum(ppu));
+    frames++;
+  }
+
+  double sec = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+  fprintf(stderr, "%d frames in %.3f sec (%.1f fps)\n",
+          frames, sec, sec > 0 ? frames / sec : 0.0);
+  return code;
+}
+
+
+
 /* ===== Main Loop & Entrypoint ===== */
 
+void handle_sdl_event(VM* vm, PPU* ppu, SDL_Event* event) {
+  switch(event->type) {
+  case SDL_QUIT:
+    quit(0);
+    break;
+  case SDL_WINDOWEVENT:
+    if (event->window.event == SDL_WINDOWEVENT_EXPOSED) render_ppu(ppu);
+    break;
+  case SDL_MOUSEBUTTONUP:
+  case SDL_MOUSEBUTTONDOWN:
+  case SDL_MOUSEMOTION:
+    handle_mouse_event(vm, event);
+    break;
+  }
+}
+
 void poll_sdl_event(VM* vm, PPU* ppu) {
   SDL_Event event;
-  
-  while (SDL_PollEvent(&event) != 0) {
-    switch(event.type) {
-    case SDL_QUIT:
-      quit(0);
-      break;
-    case SDL_WINDOWEVENT:
-      if (event.window.event == SDL_WINDOWEVENT_EXPOSED) render_ppu(ppu);
-      break;
-    case SDL_MOUSEBUTTONUP:
-    case SDL_MOUSEBUTTONDOWN:
-    case SDL_MOUSEMOTION:
-      handle_mouse_event(vm, &event);
-      break;
-    }
-  }
+  while (SDL_PollEvent(&event) != 0) handle_sdl_event(vm, ppu, &event);
+}
+
+void wait_sdl_event(VM* vm, PPU* ppu, Cell msec) {
+  // sleep until next event or msec
+  SDL_Event event;
+  if (SDL_WaitEventTimeout(&event, msec)) handle_sdl_event(vm, ppu, &event);
+  poll_sdl_event(vm, ppu);
 }
 
 
 Code run(VM* vm) {
   Code code = ARK_OK;
- 
+  init_pacer();
+
   while (1) {
-    double start = SDL_GetPerformanceCounter();
-    
-    while (!ppu->req_redraw) {
-      poll_sdl_event(vm, ppu);
-      req_poll = 0;
-      int i = 0;
-      while (!ppu->req_redraw && !req_poll && i < poll_step) {
-        code = ark_step(vm);
-        if (code != ARK_OK) return code;
-        i++;
-      }
+    if (req_poll && idle_poll()) wait_sdl_event(vm, ppu, msec_to_deadline());
+    else poll_sdl_event(vm, ppu);
+    req_poll = 0;
+
+    Cell budget = step_budget();
+    Uint64 since = now();
+    int i = 0;
+    while (!ppu->req_redraw && !req_poll && i < budget) {
+      code = ark_step(vm);
+      if (code != ARK_OK) return code;
+      i++;
     }
+    measure_steps(i, since);
 
+    if (!ppu->req_redraw) { roll_frame(); continue; }
     // dbg_draw_envs(ppu);
     render_ppu(ppu);
     ppu->req_redraw = 0;
-
-    // adjust FPS
-    double elapsed = (SDL_GetPerformanceCounter() - start); // count
-    double elapsed_msec = elapsed / SDL_GetPerformanceFrequency() * 1000.0f; // count / (count/sec) * msec/sec
-    double rest_msec = 16.666f - elapsed_msec;
-    SDL_Delay(rest_msec > 0 ? rest_msec : 0);
+    end_frame();
   }
- 
+
   return code;
 }
 
 
+
+/* ===== Threaded Main Loop ===== */
+
+/* ----- input: main -> vm ----- */
+
+#define EVENT_QUEUE_SIZE 256 // power of 2
+
+typedef struct EventQueue {
+  SDL_Event   events[EVENT_QUEUE_SIZE];
+  atomic_uint head; // written by main
+  atomic_uint tail; // written by vm
+} EventQueue;
+
+EventQueue event_queue;
+
+
+int push_event(EventQueue* q, SDL_Event* ev) {
+  unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  unsigned tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+  if (head - tail == EVENT_QUEUE_SIZE) return 0; // full: drop
+  q->events[head % EVENT_QUEUE_SIZE] = *ev;
+  atomic_store_explicit(&q->head, head + 1, memory_order_release);
+  return 1;
+}
+
+int pop_event(EventQueue* q, SDL_Event* ev) {
+  unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  unsigned head = atomic_load_explicit(&q->head, memory_order_acquire);
+  if (head == tail) return 0;
+  *ev = q->events[tail % EVENT_QUEUE_SIZE];
+  atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+  return 1;
+}
+
+
+/* ----- frames: vm -> main (triple buffer) ----- */
+
+#define FRAME_FRESH 4 // flag on middle
+
+typedef struct FrameSlot {
+  Byte* pixels;
+  Byte* dirty;
+  UCell lut[PALETTES * COLORS];
+} FrameSlot;
+
+typedef struct FrameBuffers {
+  FrameSlot  slots[3];
+  int        back;   // vm writes
+  int        front;  // main reads
+  atomic_int middle; // slot | FRAME_FRESH
+} FrameBuffers;
+
+FrameBuffers frames;
+
+
+void init_frames(PPU* ppu) {
+  for (int i = 0; i < 3; i++) {
+    FrameSlot* slot = &frames.slots[i];
+    if (!(slot->pixels = calloc(sizeof(Byte), ppu->pixels))) die("Can't create frame");
+    if (!(slot->dirty = calloc(sizeof(Byte), ppu->tiles_w * ppu->tiles_h)))
+      die("Can't create frame-dirty");
+  }
+  frames.back  = 0;
+  frames.front = 1;
+  atomic_init(&frames.middle, 2);
+}
+
+void publish_frame(PPU* ppu) {
+  // vm: fg to back, then swap back and middle
+  FrameSlot* slot = &frames.slots[frames.back];
+  memcpy(slot->pixels, ppu->fg, ppu->pixels);
+  memcpy(slot->lut, ppu->lut, sizeof(slot->lut));
+  // every tile: no tracking against what main has shown
+  memset(slot->dirty, 1, ppu->tiles_w * ppu->tiles_h);
+  frames.back = atomic_exchange(&frames.middle, frames.back | FRAME_FRESH) & 3;
+}
+
+int take_frame() {
+  // main: swap front and middle if fresh
+  if (!(atomic_load(&frames.middle) & FRAME_FRESH)) return 0;
+  frames.front = atomic_exchange(&frames.middle, frames.front) & 3;
+  return 1;
+}
+
+
+/* ----- threads ----- */
+
+/* Only the main thread quits: SDL_QUIT stops the vm thread and waits it,
+   die on the vm thread unwinds it to report back through vm_done,
+   die on the main thread stops the vm thread before exit. */
+
+atomic_int vm_done;
+atomic_int vm_stop;
+int  vm_died; // die on the vm thread, already reported
+Code vm_code;
+SDL_Thread* vm_thread_handle = NULL;
+_Thread_local jmp_buf* vm_abort = NULL; // set on the vm thread
+
+
+void wait_event_queue(EventQueue* q, Cell msec) {
+  // sleep until next event or msec
+  Uint64 until = now() + msec * pacer.freq / 1000;
+  while (atomic_load(&q->head) == atomic_load(&q->tail) && now() < until) SDL_Delay(1);
+}
+
+
+void stop_vm_thread() {
+  SDL_Thread* thread = vm_thread_handle;
+  if (!thread) return;
+  vm_thread_handle = NULL;
+  atomic_store(&vm_stop, 1);
+  SDL_WaitThread(thread, NULL);
+}
+
+void die_in_threads() {
+  if (vm_abort) longjmp(*vm_abort, 1);
+  stop_vm_thread();
+}
+
+
+int vm_thread(void* data) {
+  VM* vm = data;
+  Code code = ARK_OK;
+  jmp_buf abort_at;
+  if (setjmp(abort_at)) {
+    vm_abort = NULL;
+    vm_died  = 1;
+    atomic_store(&vm_done, 1);
+    return 1;
+  }
+  vm_abort = &abort_at;
+  init_pacer();
+
+  while (!atomic_load(&vm_stop)) {
+    if (req_poll && idle_poll()) wait_event_queue(&event_queue, msec_to_deadline());
+    SDL_Event event;
+    while (pop_event(&event_queue, &event)) handle_mouse_event(vm, &event);
+    req_poll = 0;
+
+    Cell budget = step_budget();
+    Uint64 since = now();
+    int i = 0;
+    while (!ppu->req_redraw && !req_poll && i < budget) {
+      code = ark_step(vm);
+      if (code != ARK_OK) goto done;
+      i++;
+    }
+    measure_steps(i, since);
+
+    if (!ppu->req_redraw) { roll_frame(); continue; }
+    publish_frame(ppu);
+    ppu->req_redraw = 0;
+    end_frame();
+  }
+
+ done:
+  vm_abort = NULL;
+  vm_code  = code;
+  atomic_store(&vm_done, 1);
+  return 0;
+}
+
+
+Code run_threaded(VM* vm) {
+  init_frames(ppu);
+  die_hook = die_in_threads;
+  vm_thread_handle = SDL_CreateThread(vm_thread, "arkam-vm", vm);
+  if (!vm_thread_handle) die("Can't create vm thread: %s", SDL_GetError());
+
+  int quitting = 0;
+  while (!atomic_load(&vm_done)) {
+    SDL_Event event;
+    int got = SDL_WaitEventTimeout(&event, 1);
+    while (got) {
+      switch (event.type) {
+      case SDL_QUIT:
+        quitting = 1;
+        atomic_store(&vm_stop, 1);
+        break;
+      case SDL_WINDOWEVENT:
+        if (event.window.event == SDL_WINDOWEVENT_EXPOSED) present_ppu(ppu);
+        break;
+      case SDL_MOUSEBUTTONUP:
+      case SDL_MOUSEBUTTONDOWN:
+      case SDL_MOUSEMOTION:
+        push_event(&event_queue, &event);
+        break;
+      default:
+        if (event.type == emu_event) handle_emu_event(&event);
+      }
+      got = SDL_PollEvent(&event);
+    }
+
+    if (take_frame()) {
+      FrameSlot* slot = &frames.slots[frames.front];
+      Frame f = { slot->pixels, slot->lut, slot->dirty, NULL };
+      upload_frame(ppu, &f);
+      present_ppu(ppu);
+    }
+  }
+
+  stop_vm_thread();
+  die_hook = NULL;
+  if (vm_died)  quit(1);
+  if (quitting) quit(0);
+  return vm_code;
+}
+
+
 void usage() {
-  fprintf(stderr, "Usage: arkam IMAGE\n");
+  fprintf(stderr, "Usage: sarkam [OPTIONS] IMAGE [ARGS]\n");
+  fprintf(stderr, "    -z, --zoom N        Window zoom\n");
+  fprintf(stderr, "    -s, --single-thread Run VM and rendering on one thread\n");
+  fprintf(stderr, "    -H, --headless      No window, no frame pacing\n");
+  fprintf(stderr, "    -f, --frames N      Headless: stop after N frames\n");
+  fprintf(stderr, "    -d, --dump PREFIX   Headless: write frames to PREFIX000000.ppm...\n");
+  fprintf(stderr, "    -c, --checksum      Headless: print checksum of each frame\n");
   exit(1);
 }
 
 
 int handle_opts(int argc, char* argv[]) {
-  const char* optstr = "hz";
+  const char* optstr = "+hz:sHf:d:c";
 
   struct option long_opts[] =
-    { { "help",  no_argument,       NULL, 'h' },
-      { "zoom",  required_argument, NULL, 'z' },
+    { { "help",          no_argument,       NULL, 'h' },
+      { "zoom",          required_argument, NULL, 'z' },
+      { "single-thread", no_argument,       NULL, 's' },
+      { "headless",      no_argument,       NULL, 'H' },
+      { "frames",        required_argument, NULL, 'f' },
+      { "dump",          required_argument, NULL, 'd' },
+      { "checksum",      no_argument,       NULL, 'c' },
+      { 0, 0, 0, 0 },
     };
 
   opterr = 0; // disable logging error
@@ -547,12 +1530,32 @@ int handle_opts(int argc, char* argv[]) {
         if (zoom == 0) die("Invalid zoom: %s", optarg);
         break;
       }
+    case 's':
+      threaded = 0;
+      break;
+    case 'H':
+      headless = 1;
+      break;
+    case 'f':
+      {
+        char* invalid = NULL;
+        max_frames = strtol(optarg, &invalid, 10);
+        if (*invalid || max_frames < 1) die("Invalid frames: %s", optarg);
+        break;
+      }
+    case 'd':
+      dump_prefix = optarg;
+      break;
+    case 'c':
+      print_checksum = 1;
+      break;
     case '?':
       fprintf(stderr, "Unknown option: %c\n", optopt);
       usage();
     }
   }
 
+  if (headless) threaded = 0;
   return optind;
 }
 
@@ -578,7 +1581,9 @@ int main(int argc, char* argv[]) {
   guard_err(vm, code);
   vm->ip = vm->result;
 
-  code = run(vm);
+  if (headless)      code = run_headless(vm);
+  else if (threaded) code = run_threaded(vm);
+  else               code = run(vm);
   guard_err(vm, code);
 
   ark_free_vm(vm);
@@ -8,15 +8,29 @@
 #include <libgen.h>
 #include <limits.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#ifndef __MINGW32__
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
 
 // ===== Library =====
+#if defined(SOL_NO_SNAPSHOT)
 #include <core.sol.h>
+#else
+#include <core.snap.h>
+#endif
 
 
 // ===== Config =====
 
 #define TOKEN_BUF_LEN 2048
 #define NEST_SEPARATOR ':'
+#define NAME_FILTER_BITS 65536
+#define HASH_INIT 14695981039346656037ULL
+#define CACHE_VERSION 5
+#define INLINE_CELLS 4 // max cells of a word inlined without inline:
+#define PEEP_LEN 8      // instructions in peephole window
 
 // ===== Usage =====
 
@@ -24,10 +38,16 @@ char* USAGE =
   "Usage: sol [options] SOURCES IMAGE\n"
   "Options:\n"
   "    -n, --no-corelib  Not to load core library\n"
+  "    -c, --cache DIR   Cache compiled include files in DIR\n"
+  "    -a, --all-words   Keep unreachable words in image\n"
+  "    -s, --snapshot H  Write compiled core library to C header H\n"
+  "    -m, --symbols F   Write word ranges and source lines to F\n"
+  "    -p, --profile F   Lay out words by call counts in F (arkam -p)\n"
   "    -h, --help        Show this help\n"
   "Example:\n"
   "    sol main.sol app.img\n"
   "    sol -n lib.sol main.sol app.img\n"
+  "    sol -c out/cache app.sol app.img\n"
   ;
 
 
@@ -82,7 +102,17 @@ typedef struct Context Context;
 
 typedef void(*WordHandler)(Context* ctx, Word* word);
 
-typedef enum { WordPrim, WordUser, WordQuot, WordConst, WordVal } WordType;
+typedef enum { WordPrim, WordUser, WordQuot, WordConst, WordVal, WordLocal } WordType;
+
+typedef enum {
+  FlagData = 1 << 0, // constant holds an address of data (datafile:)
+  FlagRet  = 1 << 1, // pops its own return address (;IF, IFRET...)
+  FlagDeep = 1 << 2, // reads return stack of callers (i, rpick, DEFER...)
+  FlagInline = 1 << 3, // body is copied to callers
+  FlagSetter = 1 << 4, // setter of val or local (next word is the getter)
+  FlagCombinator = 1 << 5, // core combinator, literal quotation is inlined
+  FlagOuter = 1 << 6, // reads locals in the frame of an outer word
+} WordFlag;
 
 struct Word {
   WordType     type;
@@ -94,8 +124,25 @@ struct Word {
   int          level;   // nested level  
   int          inst;
   Cell         back;    // back patching address for control flow
+  Cell         end;     // end of code (next of the last RET)
+  int          flags;
+  int          serial;  // order of definition
+  int          locals;  // number of locals in its frame
 };
 
+
+/* ===== Cell Kinds =====
+   Every cell of code has its kind for relocation.
+   Code: instruction or number
+   Call: address of a word to call
+   Addr: address in code (lit &word, jmp &addr, 0jmp &addr)
+   Link: link of val back patching chain
+   Data: string or blob
+   DataAddr: address in data (left by data:)
+*/
+
+typedef enum { CellCode = 0, CellCall, CellAddr, CellLink, CellData, CellDataAddr } CellKind;
+
 typedef struct Source {
   char* fname;
   char* text;
@@ -103,6 +150,25 @@ typedef struct Source {
   struct Source* next;
 } Source;
 
+typedef struct Unit Unit;
+
+typedef struct Loc {
+  char* fname;
+  int   line;
+} Loc;
+
+typedef struct Case {
+  Word*  word;   // word which opened the CASE
+  Cell   jmp;    // operand of jump to the dispatch
+  Cell   deflt;  // start of default (next of the last ENDOF)
+  Cell   exits;  // chain of jumps to ENDCASE
+  int    n;
+  int    cap;
+  Cell*  keys;
+  Cell*  addrs;
+  struct Case* prev;
+} Case;
+
 struct Context {
   ArkamVM* vm;
   Cell     start;         // entry point address
@@ -118,10 +184,31 @@ struct Context {
   Word*    dict;
   Word*    current;       // current defining word
   int      search_level;
+  Byte*    kinds;         // CellKind of each cell
+  int      serial;        // serial number of the latest word
+  Unit*    unit;          // recording include unit (innermost)
+  char*    cache_dir;
+  Cell     peep[PEEP_LEN]; // peephole window: addresses of instructions
+  int      peep_n;
+  Cell     peep_end;
+  int      shake;         // drop unreachable words at save
+  char*    profile_name;  // call counts for code layout (NULL: source order)
+  Cell     quot;          // address of `lit &quot` put by the latest ]
+  Case*    cases;         // open CASE blocks (innermost first)
+  char*    symbols_name;  // symbol file (NULL: not written)
+  int*     locs;          // source location of each cell (index of loc_table)
+  Loc*     loc_table;     // 0 is unknown
+  int      loc_n;
+  int      loc_cap;
+  int      loc;           // location of current token
+  char*    line_p;        // lines are counted up to here
+  int      line;
+  uint64_t name_filter[NAME_FILTER_BITS / 64]; // names in dict (bloom filter)
 };
 
 typedef struct SolOption {
-  int use_corelib;
+  int   use_corelib;
+  char* snapshot;
 } SolOption;
 
 
@@ -130,6 +217,11 @@ Word* find_word(Context* ctx, char* name);
 int read_number(Context* ctx, Cell* result);
 char* read_source(char* fname);
 void compile_source(Context* ctx);
+void clear_peephole(Context* ctx);
+void uncache_units(Context* ctx);
+int inline_combinator(Context* ctx, Word* word);
+void mark_loc(Context* ctx);
+uint64_t hash_bytes(uint64_t h, const void* data, int len);
 
 
 // Debug print for internal use
@@ -159,8 +251,10 @@ DebugAid void debug_print(char* filename, int line, char* fmt, ...) {
 // =============================================================================
 #define Put(v)  (put(ctx, (v)))
 #define PutN(n) (putn(ctx, (n)))
-#define PutI(i) (put(ctx, (ARK_INST_##i << 1) | 0x01))
+#define Inst(i) ((ARK_INST_##i << 1) | 0x01)
+#define PutI(i) (put(ctx, Inst(i)))
 #define PutB(v) (putb(ctx, (v)))
+#define PutK(v, kind) (put_kind(ctx, (v), (kind)))
 
 
 // Align
@@ -218,29 +312,135 @@ void die_at(Context* ctx, char* fmt, ...) {
 }
 
 
+// Arena
+// =============================================================================
+
+/* Words, their names and source texts live until the end of compiling.
+   They are allocated from the arena (or mapped, except on MinGW)
+   and freed at once.
+*/
+
+#define ARENA_CHUNK (256 * 1024)
+
+typedef struct Chunk {
+  struct Chunk* next;
+  size_t used;
+  size_t size;
+  Byte   data[];
+} Chunk;
+
+Chunk* arena = NULL;
+
+#ifndef __MINGW32__
+typedef struct Mapping {
+  void*  addr;
+  size_t len;
+  struct Mapping* next;
+} Mapping;
+
+Mapping* mappings = NULL;
+#endif
+
+void* arena_alloc(size_t size) {
+  // zero cleared
+  size = (size + 7) & ~(size_t)7;
+  if (!arena || arena->used + size > arena->size) {
+    size_t cap = size > ARENA_CHUNK ? size : ARENA_CHUNK;
+    Chunk* c = calloc(sizeof(Chunk) + cap, 1);
+    if (!c) die("Can't allocate arena");
+    c->size = cap;
+    c->next = arena;
+    arena   = c;
+  }
+  void* p = arena->data + arena->used;
+  arena->used += size;
+  return p;
+}
+
+char* arena_str(const char* s, int len) {
+  char* copy = arena_alloc(len + 1);
+  memcpy(copy, s, len);
+  return copy;
+}
+
+void free_arena() {
+#ifndef __MINGW32__
+  for (Mapping* m = mappings; m; m = m->next) munmap(m->addr, m->len);
+  mappings = NULL;
+#endif
+  while (arena) {
+    Chunk* next = arena->next;
+    free(arena);
+    arena = next;
+  }
+}
+
+
 // Dictionary
 // =============================================================================
 
 Word* new_word(WordType type) {
-  Word* word = calloc(sizeof(Word), 1);
+  Word* word = arena_alloc(sizeof(Word));
   word->type = type;
   return word;
 }
 
+/* Most tokens are primitives or numbers which are not in dict.
+   find_word skips searching dict if the name and its parents
+   (foo of foo:bar) are not in name_filter.
+*/
+
+void filter_bits(const char* name, int len, int* a, int* b) {
+  uint64_t h = hash_bytes(HASH_INIT, name, len);
+  *a = h % NAME_FILTER_BITS;
+  *b = (h >> 32) % NAME_FILTER_BITS;
+}
+
+void note_name(Context* ctx, const char* name) {
+  int a, b;
+  filter_bits(name, strlen(name), &a, &b);
+  ctx->name_filter[a / 64] |= 1ULL << (a % 64);
+  ctx->name_filter[b / 64] |= 1ULL << (b % 64);
+}
+
+int maybe_named(Context* ctx, const char* name, int len) {
+  int a, b;
+  filter_bits(name, len, &a, &b);
+  return (ctx->name_filter[a / 64] >> (a % 64) & 1)
+    && (ctx->name_filter[b / 64] >> (b % 64) & 1);
+}
+
+int maybe_in_dict(Context* ctx, const char* name) {
+  int len = strlen(name);
+  for (int i = 0; i < len; i++)
+    if (name[i] == NEST_SEPARATOR && maybe_named(ctx, name, i)) return 1;
+  return maybe_named(ctx, name, len);
+}
+
+char* copy_str(const char* s) {
+  int   len  = strlen(s) + 1;
+  char* copy = calloc(sizeof(char), len);
+  if (!copy) die("Can't allocate string");
+  strcpy(copy, s);
+  return copy;
+}
+
 Word* create_dict_entry(Context* ctx, const char* cname) {
   Word* parent = ctx->current;
 
+  // ENTER of parent is put again after this
+  if (parent && parent->locals && ctx->here == parent->inst + Cells(2))
+    ctx->here = parent->inst;
   if (parent && parent->inst != ctx->here)
     die_at(ctx, "Nested word %s is not at first of parent definition", cname);
   if (parent && parent->type == WordQuot)
     die_at(ctx, "Do not create nested word in quotation");
     
-  int   len  = strlen(cname) + 1;
-  char* name = calloc(sizeof(char), len);
-  strcpy(name, cname);
-
   Word* word = new_word(WordUser);
-  word->name = name;
+  word->name   = arena_str(cname, strlen(cname));
+  word->serial = ++ctx->serial;
+  note_name(ctx, cname);
+  clear_peephole(ctx);
   
   // Push current definition stack
   word->parent = parent;
@@ -262,14 +462,10 @@ Word* create_dict_entry(Context* ctx, const char* cname) {
 }
 
 void free_dict(Word* word) {
-  while(word) {
-    Word* now = word;
-    word = word->child ? word->child : word->next;
-    if (now->type == WordQuot)
-      die("Quotation entry remains dictionary");    
-    free(now->name);
-    free(now);
-  }
+  // words are freed with the arena
+  for (; word; word = word->child ? word->child : word->next)
+    if (word->type == WordQuot) die("Quotation entry remains dictionary");
+  free_arena();
 }
 
 
@@ -290,25 +486,198 @@ void dump(Context* ctx) {
 // Builder
 // =============================================================================
 
-void put(Context* ctx, Cell v) {
+void put_kind(Context* ctx, Cell v, CellKind kind) {
   VM* vm = ctx->vm;
   Set(ctx->here, v);
+  ctx->kinds[ctx->here / sizeof(Cell)] = kind;
+  if (ctx->locs) ctx->locs[ctx->here / sizeof(Cell)] = ctx->loc;
   ctx->here += Cells(1);
 }
 
-void putn(Context* ctx, Cell n) {
-  PutI(LIT);
-  put(ctx, n);
+void put(Context* ctx, Cell v) {
+  put_kind(ctx, v, CellCode);
 }
 
 void putb(Context* ctx, Byte v) {
   // put a byte
   VM* vm = ctx->vm;
   Set(ctx->here, v);
+  ctx->kinds[ctx->here / sizeof(Cell)] = CellData;
+  if (ctx->locs) ctx->locs[ctx->here / sizeof(Cell)] = ctx->loc;
   ctx->here += 1;
 }
 
 
+// Peephole
+// =============================================================================
+
+/* Literals and instructions put by putn and put_op are recorded in
+   the peephole window, and literal arithmetic and no-op sequences
+   at the end of the window are rewritten.
+   The window is cleared if other cells are put (peep_end != here)
+   or here becomes a jump target (clear_peephole),
+   so only the first of the window can be a jump target.
+*/
+
+int has_operand(Cell v) {
+  // JTBL n is followed by n addresses (CellAddr)
+  return v == Inst(LIT) || v == Inst(JMP) || v == Inst(ZJMP)
+    || v == Inst(ENTER) || v == Inst(LGET) || v == Inst(LSET) || v == Inst(JTBL);
+}
+
+void clear_peephole(Context* ctx) {
+  ctx->peep_n = 0;
+}
+
+void record_op(Context* ctx) {
+  if (ctx->peep_end != ctx->here) clear_peephole(ctx);
+  if (ctx->peep_n == PEEP_LEN) {
+    memmove(ctx->peep, ctx->peep + 1, sizeof(Cell) * (PEEP_LEN - 1));
+    ctx->peep_n--;
+  }
+  ctx->peep[ctx->peep_n++] = ctx->here;
+}
+
+Cell peep_op(Context* ctx, int back) {
+  // instruction of back-th from the last or 0
+  VM* vm = ctx->vm;
+  if (ctx->peep_end != ctx->here || back >= ctx->peep_n) return 0;
+  return Get(ctx->peep[ctx->peep_n - 1 - back]);
+}
+
+int peep_lit(Context* ctx, int back, Cell* v) {
+  VM* vm = ctx->vm;
+  if (peep_op(ctx, back) != Inst(LIT)) return 0;
+  *v = Get(ctx->peep[ctx->peep_n - 1 - back] + Cells(1));
+  return 1;
+}
+
+int peep_is(Context* ctx, int back, Cell n) {
+  Cell v;
+  return peep_lit(ctx, back, &v) && v == n;
+}
+
+void unput_ops(Context* ctx, int n) {
+  ctx->peep_n  -= n;
+  ctx->here     = ctx->peep[ctx->peep_n];
+  ctx->peep_end = ctx->here;
+}
+
+int fold(Cell op, Cell a, Cell b, Cell* r) {
+  // returns whether `a b op` can be folded
+  UCell ua = a;
+  UCell ub = b;
+  switch (op >> 1) {
+  case ARK_INST_ADD: *r = ua + ub;             return 1;
+  case ARK_INST_SUB: *r = ua - ub;             return 1;
+  case ARK_INST_MUL: *r = ua * ub;             return 1;
+  case ARK_INST_EQ:  *r = a == b ? -1 : 0;     return 1;
+  case ARK_INST_NEQ: *r = a != b ? -1 : 0;     return 1;
+  case ARK_INST_GT:  *r = a >  b ? -1 : 0;     return 1;
+  case ARK_INST_LT:  *r = a <  b ? -1 : 0;     return 1;
+  case ARK_INST_AND: *r = a & b;               return 1;
+  case ARK_INST_OR:  *r = a | b;               return 1;
+  case ARK_INST_XOR: *r = a ^ b;               return 1;
+  case ARK_INST_LSHIFT:
+    if (b >= 32 || b <= -32) return 0;
+    *r = b > 0 ? ua << b : ua >> -b;
+    return 1;
+  case ARK_INST_ASHIFT:
+    if (b >= 32 || b <= -32 || (b > 0 && a < 0)) return 0;
+    *r = b > 0 ? (Cell)(ua << b) : a >> -b;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+void putn(Context* ctx, Cell n);
+void put_op(Context* ctx, Cell op);
+
+void peephole(Context* ctx) {
+  Cell op = peep_op(ctx, 0);
+  Cell a, b, r;
+
+  // a b op => r
+  if (peep_lit(ctx, 2, &a) && peep_lit(ctx, 1, &b)) {
+    if (fold(op, a, b, &r)) {
+      unput_ops(ctx, 3);
+      putn(ctx, r);
+      return;
+    }
+    if (op == Inst(DMOD) && b != 0 && !(a == ARK_MIN_INT && b == -1)) {
+      unput_ops(ctx, 3);
+      putn(ctx, a / b);
+      putn(ctx, a % b);
+      return;
+    }
+    if (op == Inst(SWAP)) {
+      unput_ops(ctx, 3);
+      putn(ctx, b);
+      putn(ctx, a);
+      return;
+    }
+  }
+
+  // a bit-not => ~a
+  if (peep_lit(ctx, 1, &a) && op == Inst(NOT)) {
+    unput_ops(ctx, 2);
+    putn(ctx, ~a);
+    return;
+  }
+
+  // no-op
+  Cell prev = peep_op(ctx, 1);
+  if ((peep_lit(ctx, 1, &a) && op == Inst(DROP))
+      || (prev == Inst(DUP)  && op == Inst(DROP))
+      || (prev == Inst(OVER) && op == Inst(DROP))
+      || (prev == Inst(SWAP) && op == Inst(SWAP))) {
+    unput_ops(ctx, 2);
+    return;
+  }
+
+  // identity: 0 + / 0 - / 1 * ...
+  int zero = peep_is(ctx, 1, 0);
+  if ((zero && (op == Inst(ADD) || op == Inst(SUB) || op == Inst(OR) || op == Inst(XOR)
+                || op == Inst(LSHIFT) || op == Inst(ASHIFT)))
+      || (peep_is(ctx, 1, 1) && op == Inst(MUL))) {
+    unput_ops(ctx, 2);
+    return;
+  }
+
+  // = 0 = => !=   != 0 = => =
+  Cell cmp = peep_op(ctx, 2);
+  if (zero && op == Inst(EQ) && (cmp == Inst(EQ) || cmp == Inst(NEQ))) {
+    unput_ops(ctx, 3);
+    put_op(ctx, cmp == Inst(EQ) ? Inst(NEQ) : Inst(EQ));
+  }
+}
+
+void putn(Context* ctx, Cell n) {
+  record_op(ctx);
+  PutI(LIT);
+  put(ctx, n);
+  ctx->peep_end = ctx->here;
+  peephole(ctx);
+}
+
+void put_op(Context* ctx, Cell op) {
+  if (has_operand(op)) {
+    Put(op);
+    return;
+  }
+  record_op(ctx);
+  Put(op);
+  ctx->peep_end = ctx->here;
+  peephole(ctx);
+}
+
+void shorten_cond(Context* ctx) {
+  // `0 != IF` is the same as `IF`
+  if (peep_is(ctx, 1, 0) && peep_op(ctx, 0) == Inst(NEQ)) unput_ops(ctx, 2);
+}
+
+
 // Source and Image file
 // =============================================================================
 
@@ -323,9 +692,9 @@ FILE* open_file(char* desc, char* fname, char* mode) {
 }
 
 Source* free_source(Source* src) {
+  // text is in the arena or mapped
   if (!src) return NULL;
   Source* next = src->next;
-  free(src->text);
   free(src);
   return next;
 }
@@ -354,14 +723,9 @@ Source* reverse_source_inplace(Source* src) {
   return before;
 }
 
-void add_corelib(Context* ctx) {
-  char* text = calloc(sizeof(core_lib), 1);
-  if (!text) die("Can't allocate corelib source");
-  strcpy(text, core_lib);
-  add_source(ctx, "core library", text);
-}
-
+#ifdef __MINGW32__
 char* read_source(char* fname) {
+  // read the whole file into the arena with a null termination
   FILE* file = open_file("source", fname, "r");
 
   // get file size
@@ -370,8 +734,7 @@ char* read_source(char* fname) {
   rewind(file);
 
   // allocate
-  char* source = calloc(sizeof(char), size + 1);
-  if (!source) die("Can't allocate buffer for source (size:%d)", size+1);
+  char* source = arena_alloc(size + 1);
 
   // read
   int read = fread(source, 1, size, file);
@@ -379,9 +742,35 @@ char* read_source(char* fname) {
   source[size] = '\0';
 
   fclose(file);
-  
   return source;
 }
+#else
+char* read_source(char* fname) {
+  /* map the file with following zeros for null termination:
+     anonymous pages of size + 1 are mapped then the file over them.
+     unmapped with the arena. */
+  int fd = open(fname, O_RDONLY);
+  if (fd < 0) die("%s(source): %s", strerror(errno), fname);
+  struct stat st;
+  if (fstat(fd, &st) != 0) die("%s(source): %s", strerror(errno), fname);
+  size_t size = st.st_size;
+
+  long   page = sysconf(_SC_PAGESIZE);
+  size_t len  = (size + 1 + page - 1) / page * page;
+  char*  text = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (text == MAP_FAILED) die("Can't map source %s", fname);
+  if (size > 0 && mmap(text, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    die("%s(source): %s", strerror(errno), fname);
+  close(fd);
+
+  Mapping* m = arena_alloc(sizeof(Mapping));
+  m->addr  = text;
+  m->len   = len;
+  m->next  = mappings;
+  mappings = m;
+  return text;
+}
+#endif
 
 Cell read_blob(VM* vm, Cell addr, char* fname) {
   /* return size */
@@ -437,25 +826,16 @@ int read_token(Context* ctx) {
   skip_spaces(ctx);
 
   char* start = ctx->p;
-  int   i    = 0;
-  int   max  = ctx->token_buf_len;
-  char  c    = *ctx->p;
+  char* end   = start;
+  if (*start == '\0') return 0;
 
-  if (c == '\0') return 0;
-  
-  while (c != '\0' && !is_space(c)) {
-    if (max <= i) {
-      ctx->p = start;
-      die_at(ctx, "Too long token");
-    }
+  while (*end != '\0' && !is_space(*end)) end++;
+  int len = end - start;
+  if (len > ctx->token_buf_len) die_at(ctx, "Too long token");
 
-    ctx->token_buf[i] = c;
-    i++;
-    ctx->p++;
-    c = *ctx->p;
-  }
-  
-  ctx->token_buf[i] = '\0';
+  memcpy(ctx->token_buf, start, len);
+  ctx->token_buf[len] = '\0';
+  ctx->p = end;
   return 1;
 }
 
@@ -472,11 +852,467 @@ int read_digit(char c, int base) {
 }
 
 
+// Tail Call
+// =============================================================================
+
+/* `foo RET` is compiled to `JMP &foo` unless foo looks at the return stack
+   out of its own frame (FlagRet or FlagDeep).
+   Flags of a word are computed from its body at semicolon.
+   Return stack depth is counted linearly, callees with FlagDeep are
+   propagated to the caller, and unknown callees are regarded as deep.
+   A word with FlagDeep never tail calls since its quotations
+   (ex. [ i ]) may be called by the tail called word.
+*/
+
+Word* word_at(Context* ctx, Cell addr) {
+  // finished word which starts at addr
+  for (Word* w = ctx->dict; w; w = w->child ? w->child : w->next) {
+    if (w->inst != addr || !w->end) continue;
+    if (w->type == WordUser || w->type == WordVal) return w;
+  }
+  return NULL;
+}
+
+int frame_flags(Context* ctx, Word* word) {
+  VM* vm = ctx->vm;
+  int flags = 0;
+  int depth = 0;
+  int min   = 0;
+
+  for (Cell a = word->inst; a < ctx->here; a += Cells(1)) {
+    Cell v = Get(a);
+    switch (ctx->kinds[a / sizeof(Cell)]) {
+    case CellCall:
+      {
+        if (v == word->inst) break; // recur
+        Word* callee = word_at(ctx, v);
+        if (!callee || (callee->flags & FlagDeep)) flags |= FlagDeep;
+        break;
+      }
+    case CellCode:
+      if (has_operand(v)) a += Cells(1);
+      if (v == Inst(RPUSH)) depth++;
+      if (v == Inst(RPOP) || v == Inst(RDROP)) depth--;
+      if (v == Inst(GETRP) || v == Inst(SETRP)) flags |= FlagDeep;
+      if (depth < min) min = depth;
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (min < 0)  flags |= FlagRet;
+  if (min < -1) flags |= FlagDeep;
+  return flags;
+}
+
+int tail_target(Context* ctx, Word* word, Cell addr) {
+  Word* callee = addr == word->inst ? word : word_at(ctx, addr);
+  return callee && !(callee->flags & (FlagRet | FlagDeep));
+}
+
+int jump_target(Context* ctx, Word* word, Cell addr) {
+  VM* vm = ctx->vm;
+  for (Cell a = word->inst; a < ctx->here; a += Cells(1))
+    if (ctx->kinds[a / sizeof(Cell)] == CellAddr && Get(a) == addr) return 1;
+  return 0;
+}
+
+void put_tail_jump(Context* ctx, Cell addr, Cell callee) {
+  VM* vm = ctx->vm;
+  Set(addr, Inst(JMP));
+  Set(addr + Cells(1), callee);
+  ctx->kinds[addr / sizeof(Cell)]     = CellCode;
+  ctx->kinds[addr / sizeof(Cell) + 1] = CellAddr;
+}
+
+void put_ret(Context* ctx, Word* word) {
+  // put RET of the word with replacing tail calls in it
+  VM* vm = ctx->vm;
+
+  if (word->flags & FlagDeep) {
+    PutI(RET);
+    return;
+  }
+
+  for (Cell a = word->inst; a + Cells(1) < ctx->here; a += Cells(1)) {
+    Cell v    = Get(a);
+    Cell next = a + Cells(1);
+    Byte kind = ctx->kinds[a / sizeof(Cell)];
+    if (kind == CellCode && has_operand(v)) {
+      a = next;
+      continue;
+    }
+    if (kind != CellCall || Get(next) != Inst(RET)) continue;
+    if (ctx->kinds[next / sizeof(Cell)] != CellCode) continue;
+    if (!tail_target(ctx, word, v) || jump_target(ctx, word, next)) continue;
+    put_tail_jump(ctx, a, v);
+    a = next;
+  }
+
+  // last call: `call` => `JMP &callee` and RET for jumps to the end
+  Cell last = ctx->here - Cells(1);
+  Cell v    = Get(last);
+  if (last < word->inst || ctx->kinds[last / sizeof(Cell)] != CellCall
+      || !tail_target(ctx, word, v)) {
+    PutI(RET);
+    return;
+  }
+
+  int jumped = 0;
+  for (Cell a = word->inst; a < ctx->here; a += Cells(1)) {
+    if (ctx->kinds[a / sizeof(Cell)] != CellAddr || Get(a) != ctx->here) continue;
+    Set(a, ctx->here + Cells(1));
+    jumped = 1;
+  }
+  put_tail_jump(ctx, last, v);
+  ctx->here = last + Cells(2);
+  if (jumped) PutI(RET);
+}
+
+
+// Inline
+// =============================================================================
+
+/* A word is inlined if its body is straight code
+   up to INLINE_CELLS cells (or defined by inline:).
+   Straight code has no calls, jumps, return stack and stack pointer operations
+   and no addresses except links of val for its getter and setter.
+*/
+
+Word* val_of(Word* word) {
+  return word->flags & FlagSetter ? word->next : word;
+}
+
+int inlinable_inst(Cell v) {
+  if (!(v & 1)) return 0;
+  switch (v >> 1) {
+  case ARK_INST_JMP:
+  case ARK_INST_ZJMP:
+  case ARK_INST_RPUSH:
+  case ARK_INST_RPOP:
+  case ARK_INST_RDROP:
+  case ARK_INST_GETSP:
+  case ARK_INST_SETSP:
+  case ARK_INST_GETRP:
+  case ARK_INST_SETRP:
+  case ARK_INST_ENTER:
+  case ARK_INST_LEAVE:
+  case ARK_INST_JTBL:
+    return 0;
+  default:
+    return 1;
+  }
+}
+
+Cell inline_end(Context* ctx, Word* word) {
+  // returns address of RET after straight code of the word or 0
+  VM* vm  = ctx->vm;
+  int val = word->type == WordVal || (word->flags & FlagSetter);
+
+  for (Cell a = word->inst; a < word->end; a += Cells(1)) {
+    Cell v = Get(a);
+    if (ctx->kinds[a / sizeof(Cell)] != CellCode) return 0;
+    if (v == Inst(RET)) return a;
+    if (v == Inst(LGET) || v == Inst(LSET)) {
+      a += Cells(1);
+      continue;
+    }
+    if (v == Inst(LIT)) {
+      a += Cells(1);
+      Byte kind = ctx->kinds[a / sizeof(Cell)];
+      if (kind == CellCode || (kind == CellLink && val)) continue;
+      return 0;
+    }
+    if (!inlinable_inst(v)) return 0;
+  }
+  return 0;
+}
+
+void check_inline(Context* ctx, Word* word) {
+  // called at semicolon
+  Cell end = inline_end(ctx, word);
+  if (word->flags & FlagInline) {
+    if (!end) die_at(ctx, "Can't inline %s", word->name);
+    return;
+  }
+  if (end && end - word->inst <= Cells(INLINE_CELLS)) word->flags |= FlagInline;
+}
+
+void inline_word(Context* ctx, Word* word) {
+  VM*  vm  = ctx->vm;
+  Cell end = inline_end(ctx, word);
+
+  for (Cell a = word->inst; a < end; a += Cells(1)) {
+    Cell v = Get(a);
+    if (v != Inst(LIT) && has_operand(v)) {
+      Put(v);
+      a += Cells(1);
+      Put(Get(a));
+      continue;
+    }
+    if (v != Inst(LIT)) {
+      put_op(ctx, v);
+      continue;
+    }
+    a += Cells(1);
+    if (ctx->kinds[a / sizeof(Cell)] == CellCode) {
+      PutN(Get(a));
+      continue;
+    }
+    // chain to val
+    Word* val  = val_of(word);
+    Cell  back = val->back;
+    PutI(LIT);
+    val->back  = ctx->here;
+    PutK(back, CellLink);
+  }
+}
+
+
+// Compile-time Execution
+// =============================================================================
+
+/* `const: x word` and `data: x word` run a compiled word in the VM
+   while compiling.
+   The word runs twice: first on a copy of the code shifted after it,
+   then on the code itself. Results moved by the shift come from addresses
+   (&word, quotations, strings, data) and are relocated at save,
+   unmoved results are numbers, others are rejected.
+   Vals are placed on scratch cells (0 at each run) and not left in image.
+   Only sys and stdio (output to stderr, on the second run) devices are
+   available.
+   The trampoline at the top of heap calls the word then halts.
+*/
+
+typedef struct ValPatch {
+  Cell  addr;
+  Cell  link;
+} ValPatch;
+
+typedef struct Comptime {
+  Cell  v;             // top of stack (or 0)
+  Cell  shifted;       // top of stack of the shifted run
+  int   n;             // number of pushed items
+  Cell  here;          // here left by the run
+  Byte* data;          // bytes allotted by the shifted run
+  Cell  delta;         // shift of the code
+  Cell  scratch;       // lowest scratch cell of both runs
+  Cell  scratch_delta; // shift of scratch cells (downward)
+} Comptime;
+
+Code handle_comptime_stdio(VM* vm, Cell op) {
+  switch (op) {
+  case 0: // putc ( c -- )
+    if (!ark_has_ds_items(vm, 1)) Raise(DS_UNDERFLOW);
+    fputc(Pop(), stderr);
+    return ARK_OK;
+  case 2: // query port
+    Push(2);
+    return ARK_OK;
+  case 3: // set port (always stderr)
+    if (!ark_has_ds_items(vm, 1)) Raise(DS_UNDERFLOW);
+    Pop();
+    return ARK_OK;
+  default: Raise(IO_UNKNOWN_OP);
+  }
+}
+
+Code handle_comptime_quiet(VM* vm, Cell op) {
+  // stdio of the shifted run: output is dropped
+  if (op != 0) return handle_comptime_stdio(vm, op);
+  if (!ark_has_ds_items(vm, 1)) Raise(DS_UNDERFLOW);
+  Pop();
+  return ARK_OK;
+}
+
+int count_vals(Context* ctx) {
+  int n = 0;
+  for (Word* w = ctx->dict; w; w = w->child ? w->child : w->next)
+    if (w->type == WordVal) n++;
+  return n;
+}
+
+ValPatch* patch_vals(Context* ctx, Cell scratch, int* ret_n) {
+  // point every val link to a scratch cell
+  VM* vm = ctx->vm;
+  int n   = 0;
+  int cap = 64;
+  ValPatch* patches = calloc(sizeof(ValPatch), cap);
+  if (!patches) die("Can't allocate val patches");
+
+  for (Word* w = ctx->dict; w; w = w->child ? w->child : w->next) {
+    if (w->type != WordVal) continue;
+    scratch -= Cells(1);
+    Set(scratch, 0);
+    for (Cell link = w->back; link != 0; link = patches[n - 1].link) {
+      if (n == cap) {
+        cap *= 2;
+        patches = realloc(patches, sizeof(ValPatch) * cap);
+        if (!patches) die("Can't allocate val patches");
+      }
+      patches[n++] = (ValPatch){ .addr = link, .link = Get(link) };
+      Set(link, scratch);
+    }
+  }
+  *ret_n = n;
+  return patches;
+}
+
+void shift_code(Context* ctx, Comptime* c, Cell scratch) {
+  // copy code to code + delta with addresses moved along,
+  // val links (patched to scratch) go to the shifted scratch cells
+  VM* vm = ctx->vm;
+  for (Cell a = ARK_ADDR_CODE_BEGIN; a < ctx->here; a += Cells(1)) {
+    Cell v = Get(a);
+    switch (ctx->kinds[a / sizeof(Cell)]) {
+    case CellCall:
+    case CellAddr:
+    case CellDataAddr:
+      v += c->delta;
+      break;
+    case CellLink:
+      if (v >= scratch) v -= c->scratch_delta;
+      break;
+    default:
+      break;
+    }
+    Set(a + c->delta, v);
+  }
+}
+
+Cell run_at(Context* ctx, Word* word, Cell entry, Cell tramp, ArkamDeviceHandler stdio, int* ret_n) {
+  /* run entry from the trampoline and returns its top of stack (or 0)
+     ret_n is set to number of pushed items */
+  VM* vm = ctx->vm;
+  Set(tramp, entry);
+  Set(tramp + Cells(1), Inst(HALT));
+
+  Cell sp = vm->sp;
+  Cell rp = vm->rp;
+  Cell fp = vm->fp;
+  vm->io_handlers[ARK_DEVICE_STDIO] = stdio;
+  vm->ip = tramp;
+  Code code = ark_run(vm);
+  vm->io_handlers[ARK_DEVICE_STDIO] = NULL;
+
+  if (code == ARK_ERR)
+    die_at(ctx, "Error in %s: %s", word->name, ark_err_str(vm->err));
+  if (vm->ip != tramp + Cells(2))
+    die_at(ctx, "%s halted", word->name);
+
+  *ret_n = (sp - vm->sp) / (Cell)sizeof(Cell);
+  Cell v = *ret_n > 0 ? Get(vm->sp + Cells(1)) : 0;
+  vm->sp = sp;
+  vm->rp = rp;
+  vm->fp = fp;
+  return v;
+}
+
+void run_word(Context* ctx, Word* word, Comptime* c) {
+  // run word on shifted code then on code, `here` starts at the end of code
+  VM* vm = ctx->vm;
+  if (word->type != WordUser || word->end == 0)
+    die_at(ctx, "%s is not a compiled word", word->name);
+
+  uncache_units(ctx);
+
+  int  vals   = count_vals(ctx);
+  Cell tramp  = vm->ds - Cells(2);
+  Cell tramp2 = tramp - Cells(vals + 2);
+  Cell here   = ctx->here;
+  c->delta         = align(here) - ARK_ADDR_CODE_BEGIN;
+  c->scratch_delta = tramp - tramp2;
+  c->scratch       = tramp2 - Cells(vals);
+  if (here + c->delta >= c->scratch) die_at(ctx, "No memory to run %s", word->name);
+
+  int n;
+  ValPatch* patches = patch_vals(ctx, tramp, &n);
+  shift_code(ctx, c, tramp - Cells(vals));
+  for (int i = 1; i <= vals; i++) Set(tramp2 - Cells(i), 0);
+
+  // shifted run
+  int  shifted_n;
+  Cell shifted_here = here + c->delta;
+  Set(ARK_ADDR_HERE, shifted_here);
+  c->shifted = run_at(ctx, word, word->inst + c->delta, tramp2, handle_comptime_quiet, &shifted_n);
+  Cell len = Get(ARK_ADDR_HERE) - shifted_here;
+  if (len > 0 && shifted_here + len > c->scratch)
+    die_at(ctx, "%s allotted too much", word->name);
+  c->data = calloc(1, len > 0 ? align(len) : 1);
+  if (!c->data) die("Can't allocate compile-time data");
+  if (len > 0) memcpy(c->data, vm->mem + shifted_here, len);
+
+  Set(ARK_ADDR_HERE, here);
+  c->v    = run_at(ctx, word, word->inst, tramp, handle_comptime_stdio, &c->n);
+  c->here = Get(ARK_ADDR_HERE);
+
+  for (int i = n - 1; i >= 0; i--) Set(patches[i].addr, patches[i].link);
+  free(patches);
+
+  if (c->n != shifted_n || c->here - here != len)
+    die_at(ctx, "%s depends on where code is", word->name);
+}
+
+CellKind comptime_kind(Context* ctx, Word* word, Comptime* c, Cell v, Cell shifted, Cell end) {
+  // Data for numbers, DataAddr for addresses in [code begin, end)
+  if (shifted == v) return CellData;
+  if (shifted == v + c->delta) {
+    if (v < ARK_ADDR_CODE_BEGIN || v >= end)
+      die_at(ctx, "%s returned an address out of code", word->name);
+    return CellDataAddr;
+  }
+  if (shifted == v - c->scratch_delta)
+    die_at(ctx, "%s returned an address of compile-time scratch", word->name);
+  die_at(ctx, "%s returned a value depending on addresses", word->name);
+  return CellData;
+}
+
+
 // Word Handlers
 // =============================================================================
 
+Word* frame_owner(Word* word) {
+  // word with locals whose frame is used while word runs (or NULL)
+  while (word && !word->locals) word = word->parent;
+  return word;
+}
+
+void use_outer_frame(Context* ctx) {
+  // current and enclosing words up to the frame owner read its locals
+  for (Word* w = ctx->current; w && !w->locals; w = w->parent) w->flags |= FlagOuter;
+}
+
+void check_outer_frame(Context* ctx, Word* word) {
+  // word reading locals of an outer frame is called only in that frame
+  Word* w = ctx->current;
+  while (w && w->type == WordQuot && !w->locals) w = w->parent;
+  Word* owner = frame_owner(word->parent);
+  if (!w || !w->locals) {
+    use_outer_frame(ctx);
+    return;
+  }
+  if (w != owner)
+    die_at(ctx, "%s uses locals of %s, can't be used in %s with locals",
+           word->name, owner ? owner->name : "an outer word", w->name);
+}
+
 void handle_inst(Context* ctx, Word* word) {
-  Put(word->inst);
+  Word* frame = ctx->current && ctx->current->locals ? ctx->current : NULL;
+  if (word->type == WordPrim) {
+    if (frame && word->inst == Inst(RET)) PutI(LEAVE);
+    put_op(ctx, word->inst);
+    return;
+  }
+  if ((word->flags & FlagCombinator) && inline_combinator(ctx, word)) return;
+  if (frame && (word->flags & (FlagRet | FlagDeep)))
+    die_at(ctx, "%s can't be used in %s with locals", word->name, frame->name);
+  if (word->flags & FlagOuter) check_outer_frame(ctx, word);
+  if (word->flags & FlagInline) {
+    inline_word(ctx, word);
+    return;
+  }
+  PutK(word->inst, CellCall);
 }
 
 void handle_colon(Context* ctx, Word* word) {
@@ -496,13 +1332,28 @@ void close_nest(Context* ctx) {
   // If in nested word back patch start of parent
   if (parent) {
     parent->inst = ctx->here;
+    if (parent->locals) {
+      PutI(ENTER);
+      Put(parent->locals);
+    }
   }  
 }
 
 void handle_semicolon(Context* ctx, Word* word) {
   if (!ctx->current) die_at(ctx, "Semicolon out of word definition");
 
-  PutI(RET);
+  Word* current = ctx->current;
+  if (ctx->cases && ctx->cases->word == current)
+    die_at(ctx, "Unclosed CASE in %s", current->name);
+  if (current->type == WordQuot) {
+    PutI(RET);
+  } else {
+    if (current->locals) PutI(LEAVE);
+    current->flags |= frame_flags(ctx, current);
+    put_ret(ctx, current);
+  }
+  current->end = ctx->here;
+  if (current->type != WordQuot) check_inline(ctx, current);
 
   close_nest(ctx);
 }
@@ -512,18 +1363,34 @@ void handle_semicolon(Context* ctx, Word* word) {
 
 void handle_const(Context* ctx, Word* word) {
   // Put `lit inst`
+  if (!(word->flags & FlagData)) {
+    PutN(word->inst);
+    return;
+  }
   PutI(LIT);
-  Put(word->inst);
+  PutK(word->inst, CellAddr);
 }
 
 void read_const(Context* ctx, Word* entry) {
   if (read_token(ctx) == 0) die_at(ctx, "Constant value required");
-  const char* err = "Constant value should be number or constant";
+  const char* err = "Constant value should be number, constant or word";
   
   Word* found = find_word(ctx, ctx->token_buf);
+  if (found && found->type == WordUser) {
+    // run at compile time
+    Comptime c;
+    run_word(ctx, found, &c);
+    free(c.data);
+    if (c.n < 1) die_at(ctx, "%s returned no value", found->name);
+    entry->inst = c.v;
+    if (comptime_kind(ctx, found, &c, c.v, c.shifted, ctx->here) == CellDataAddr)
+      entry->flags = FlagData;
+    return;
+  }
   if (found) {
     if (found->type != WordConst) die_at(ctx, "%s", err);
-    entry->inst = found->inst;
+    entry->inst  = found->inst;
+    entry->flags = found->flags & FlagData;
     return;
   }
 
@@ -546,6 +1413,48 @@ void handle_defconst(Context* ctx, Word* word) {
 
 
 
+/* ----- defdata -----
+   example:
+     data: squares make-squares
+   runs make-squares at compile time with `here` at the end of code.
+   Bytes allotted by it are left in image and squares is their address.
+*/
+
+void handle_defdata(Context* ctx, Word* word) {
+  VM* vm = ctx->vm;
+  if (read_token(ctx) == 0) die_at(ctx, "data: name required");
+  if (ctx->here != align(ctx->here)) die_at(ctx, "data: not aligned before");
+
+  Word* entry = create_dict_entry(ctx, ctx->token_buf);
+  entry->type    = WordConst;
+  entry->flags   = FlagData;
+  entry->handler = handle_const;
+  entry->inst    = ctx->here;
+
+  if (read_token(ctx) == 0) die_at(ctx, "data: word required");
+  Word* found = find_word(ctx, ctx->token_buf);
+  if (!found) die_at(ctx, "Unknown word %s", ctx->token_buf);
+
+  Comptime c;
+  run_word(ctx, found, &c);
+  Cell end = align(c.here);
+  if (end <= ctx->here) die_at(ctx, "%s allotted nothing", found->name);
+  if (end > c.scratch) die_at(ctx, "%s allotted too much", found->name);
+
+  memset(vm->mem + c.here, 0, end - c.here); // padding as in the shifted run
+  for (Cell a = ctx->here; a < end; a += sizeof(Cell)) {
+    Cell shifted;
+    memcpy(&shifted, c.data + (a - ctx->here), sizeof(Cell));
+    ctx->kinds[a / sizeof(Cell)] = comptime_kind(ctx, found, &c, Get(a), shifted, end);
+  }
+  free(c.data);
+  ctx->here  = end;
+  entry->end = end;
+
+  close_nest(ctx);
+}
+
+
 /* ----- defval -----
    example:
      val: x
@@ -561,6 +1470,11 @@ void handle_defconst(Context* ctx, Word* word) {
    Backpatching should insert a same heap address to ADDR1 and ADDR2.
 */
 
+void handle_definline(Context* ctx, Word* word) {
+  handle_colon(ctx, word);
+  ctx->current->flags |= FlagInline;
+}
+
 void handle_defval(Context* ctx, Word* word) {
   if (read_token(ctx) == 0) die_at(ctx, "Word name required");
   int len = strlen(ctx->token_buf);
@@ -578,7 +1492,7 @@ void handle_defval(Context* ctx, Word* word) {
 
   PutI(LIT);
   entry->back = ctx->here;
-  Put(0);
+  PutK(0, CellLink);
   PutI(GET);
 
   handle_semicolon(ctx, entry);
@@ -589,13 +1503,14 @@ void handle_defval(Context* ctx, Word* word) {
   ctx->token_buf[len] = '!';
   Word* setter = create_dict_entry(ctx, ctx->token_buf);
   setter->type    = WordUser;
+  setter->flags   = FlagSetter;
   setter->handler = handle_inst;
   setter->inst    = ctx->here;
 
   PutI(LIT);
   Cell back = entry->back;
   entry->back = ctx->here;
-  Put(back);
+  PutK(back, CellLink);
   PutI(SET);
   PutI(RET);
 
@@ -603,6 +1518,66 @@ void handle_defval(Context* ctx, Word* word) {
 }
 
 
+/* ----- deflocal -----
+   example:
+     : foo ( a b -- a+b )
+       local: a  local: b
+       b! a! a b + ;
+
+   creates words which access cells of the frame of foo on return stack
+     a  => LGET 0
+     a! => LSET 0
+   foo starts with `ENTER n` (n: number of locals)
+   and `LEAVE` is put before its RETs.
+   Nested words without their own locals also access the frame of foo
+   while foo is running. They (and words calling them) get FlagOuter
+   and can't be used in other words with locals.
+*/
+
+void handle_local(Context* ctx, Word* word) {
+  Word* owner = word->parent;
+  for (Word* w = ctx->current; w != owner; w = w->parent) {
+    if (!w) die_at(ctx, "Local %s out of %s", word->name, owner->name);
+    if (w->locals) die_at(ctx, "Local %s of %s in %s with locals", word->name, owner->name, w->name);
+  }
+  if (ctx->current != owner) use_outer_frame(ctx);
+  PutI(LGET);
+  Put(word->inst);
+}
+
+void handle_local_set(Context* ctx, Word* word) {
+  VM* vm = ctx->vm;
+  handle_local(ctx, word->next);
+  Set(ctx->here - Cells(2), Inst(LSET));
+}
+
+void handle_deflocal(Context* ctx, Word* word) {
+  Word* owner = ctx->current;
+  if (!owner) die_at(ctx, "local: out of word definition");
+  if (read_token(ctx) == 0) die_at(ctx, "Word name required");
+  int len = strlen(ctx->token_buf);
+  if (len + 1 >= TOKEN_BUF_LEN) die_at(ctx, "Too long local name: %s", ctx->token_buf);
+  ctx->token_buf[len+1] = '\0'; // for local!
+
+  Cell index = owner->locals;
+
+  Word* entry = create_dict_entry(ctx, ctx->token_buf);
+  entry->type    = WordLocal;
+  entry->handler = handle_local;
+  entry->inst    = index;
+  owner->locals++;
+  close_nest(ctx);
+
+  ctx->token_buf[len] = '!';
+  Word* setter = create_dict_entry(ctx, ctx->token_buf);
+  setter->type    = WordLocal;
+  setter->flags   = FlagSetter;
+  setter->handler = handle_local_set;
+  setter->inst    = index;
+  close_nest(ctx);
+}
+
+
 /* ----- if/else -----
    `if` and `else` pushes back patching address to stack of vm.
    `else` and `end` do back patching.
@@ -624,9 +1599,10 @@ void handle_defval(Context* ctx, Word* word) {
 
 void handle_if(Context* ctx, Word* word) {
   VM* vm = ctx->vm;
+  shorten_cond(ctx);
   PutI(ZJMP);
   Push(ctx->here); // for back patching
-  Put(0); // tmporary
+  PutK(0, CellAddr); // tmporary
 }
 
 void handle_else(Context* ctx, Word* word) {
@@ -635,7 +1611,7 @@ void handle_else(Context* ctx, Word* word) {
   // put jump for if-else block
   PutI(JMP);
   Cell back = ctx->here;
-  Put(0); // temporary
+  PutK(0, CellAddr); // temporary
   
   // swap back patch address
   Cell addr = Pop();
@@ -649,6 +1625,260 @@ void handle_end(Context* ctx, Word* word) {
   VM* vm = ctx->vm;
   Cell addr = Pop();
   Set(addr, ctx->here);
+  clear_peephole(ctx);
+}
+
+
+/* ----- loop -----
+   Loops are compiled inline and back patched like IF.
+
+   n DO ... LOOP   runs its body n times with index 0..n-1 (I)
+     compiles: >r lit 0 >r
+         (L):  r> r> over over >r >r < 0jmp &EXIT
+               ...
+               r> lit 1 + >r jmp &L
+      (EXIT):  rdrop rdrop
+   the limit and the index are held on return stack.
+   I is the index of the innermost loop and J is of the outer one.
+
+   BEGIN ... ? WHILE ... REPEAT   loops while ? is true
+   BEGIN ... ? UNTIL              loops until ? is true
+     compiles: (L): ... 0jmp &EXIT ... jmp &L (EXIT):
+               (L): ... 0jmp &L
+*/
+
+void put_loop_head(Context* ctx) {
+  // push address of loop head for back jump
+  VM* vm = ctx->vm;
+  clear_peephole(ctx);
+  Push(ctx->here);
+}
+
+void put_exit(Context* ctx) {
+  // exit from loop if false
+  VM* vm = ctx->vm;
+  shorten_cond(ctx);
+  PutI(ZJMP);
+  Push(ctx->here); // for back patching
+  PutK(0, CellAddr); // temporary
+}
+
+void handle_do(Context* ctx, Word* word) {
+  PutI(RPUSH);
+  PutI(LIT);
+  Put(0);
+  PutI(RPUSH);
+  put_loop_head(ctx);
+  PutI(RPOP);
+  PutI(RPOP);
+  PutI(OVER);
+  PutI(OVER);
+  PutI(RPUSH);
+  PutI(RPUSH);
+  PutI(LT);
+  put_exit(ctx);
+}
+
+void handle_loop(Context* ctx, Word* word) {
+  VM* vm = ctx->vm;
+  Cell exit = Pop();
+  Cell head = Pop();
+  PutI(RPOP);
+  PutI(LIT);
+  Put(1);
+  PutI(ADD);
+  PutI(RPUSH);
+  PutI(JMP);
+  PutK(head, CellAddr);
+  Set(exit, ctx->here);
+  PutI(RDROP);
+  PutI(RDROP);
+  clear_peephole(ctx);
+}
+
+void handle_index(Context* ctx, Word* word) {
+  // I: r> dup >r
+  PutI(RPOP);
+  PutI(DUP);
+  PutI(RPUSH);
+}
+
+void handle_outer_index(Context* ctx, Word* word) {
+  // J: r> r> r> dup >r swap >r swap >r
+  PutI(RPOP);
+  PutI(RPOP);
+  PutI(RPOP);
+  PutI(DUP);
+  PutI(RPUSH);
+  PutI(SWAP);
+  PutI(RPUSH);
+  PutI(SWAP);
+  PutI(RPUSH);
+}
+
+void handle_begin(Context* ctx, Word* word) {
+  put_loop_head(ctx);
+}
+
+void handle_while(Context* ctx, Word* word) {
+  put_exit(ctx);
+}
+
+void handle_repeat(Context* ctx, Word* word) {
+  VM* vm = ctx->vm;
+  Cell exit = Pop();
+  Cell head = Pop();
+  PutI(JMP);
+  PutK(head, CellAddr);
+  Set(exit, ctx->here);
+  clear_peephole(ctx);
+}
+
+void handle_until(Context* ctx, Word* word) {
+  VM* vm = ctx->vm;
+  Cell head = Pop();
+  shorten_cond(ctx);
+  PutI(ZJMP);
+  PutK(head, CellAddr);
+}
+
+
+/* ----- case -----
+   CASE dispatches by the top of stack with literal keys.
+
+     CASE  1 OF foo ENDOF  2 OF bar ENDOF  baz ENDCASE
+
+   The selector is dropped at the start of each case body.
+   Code after the last ENDOF is default, it sees the selector
+   and ENDCASE drops it.
+   Dispatch is put after the bodies since keys are known at ENDCASE.
+   Dense keys (range <= CASE_DENSITY * number of keys) use a jump table.
+
+     compiles: jmp &D
+      (C1):    drop foo jmp &EXIT
+      (C2):    drop bar jmp &EXIT
+     (DEF):    baz drop jmp &EXIT
+       (D):    dup lit 1 - jtbl 2 &C1 &C2 jmp &DEF
+    (EXIT):
+
+   Sparse keys are compared one by one: dup lit k != 0jmp &Ck ... jmp &DEF
+*/
+
+#define CASE_DENSITY 4
+
+Case* current_case(Context* ctx, char* name) {
+  Case* c = ctx->cases;
+  if (!c || c->word != ctx->current) die_at(ctx, "%s out of CASE", name);
+  return c;
+}
+
+void put_case_exit(Context* ctx, Case* c) {
+  // jmp to ENDCASE chained with the previous ones
+  PutI(JMP);
+  PutK(c->exits, CellAddr);
+  c->exits = ctx->here - Cells(1);
+}
+
+void handle_case(Context* ctx, Word* word) {
+  Case* c = calloc(sizeof(Case), 1);
+  if (!c) die_at(ctx, "Can't allocate CASE");
+  c->word = ctx->current;
+  c->prev = ctx->cases;
+  ctx->cases = c;
+
+  PutI(JMP);
+  c->jmp = ctx->here;
+  PutK(0, CellAddr); // temporary
+  c->deflt = ctx->here;
+  clear_peephole(ctx);
+}
+
+void handle_of(Context* ctx, Word* word) {
+  Case* c = current_case(ctx, "OF");
+  Cell key;
+  if (!peep_lit(ctx, 0, &key) || ctx->kinds[(ctx->here - Cells(1)) / sizeof(Cell)] != CellCode)
+    die_at(ctx, "OF requires a number");
+  unput_ops(ctx, 1);
+  if (ctx->here != c->deflt) die_at(ctx, "Code before OF");
+  for (int i = 0; i < c->n; i++)
+    if (c->keys[i] == key) die_at(ctx, "Duplicated case %d", key);
+
+  if (c->n == c->cap) {
+    c->cap   = c->cap ? c->cap * 2 : 8;
+    c->keys  = realloc(c->keys,  sizeof(Cell) * c->cap);
+    c->addrs = realloc(c->addrs, sizeof(Cell) * c->cap);
+    if (!c->keys || !c->addrs) die_at(ctx, "Can't allocate CASE");
+  }
+  c->keys[c->n]  = key;
+  c->addrs[c->n] = ctx->here;
+  c->n++;
+  PutI(DROP);
+}
+
+void handle_endof(Context* ctx, Word* word) {
+  Case* c = current_case(ctx, "ENDOF");
+  put_case_exit(ctx, c);
+  c->deflt = ctx->here;
+  clear_peephole(ctx);
+}
+
+void handle_endcase(Context* ctx, Word* word) {
+  VM*   vm = ctx->vm;
+  Case* c  = current_case(ctx, "ENDCASE");
+
+  // default
+  Cell deflt = c->deflt;
+  PutI(DROP);
+  put_case_exit(ctx, c);
+
+  // dispatch
+  Set(c->jmp, ctx->here);
+  Cell min = 0;
+  Cell max = 0;
+  for (int i = 0; i < c->n; i++) {
+    if (i == 0 || c->keys[i] < min) min = c->keys[i];
+    if (i == 0 || c->keys[i] > max) max = c->keys[i];
+  }
+  int64_t range = (int64_t)max - min + 1;
+
+  if (c->n > 0 && range <= (int64_t)c->n * CASE_DENSITY) {
+    PutI(DUP);
+    if (min != 0) {
+      PutI(LIT);
+      Put(min);
+      PutI(SUB);
+    }
+    PutI(JTBL);
+    Put(range);
+    Cell table = ctx->here;
+    for (Cell i = 0; i < range; i++) PutK(deflt, CellAddr);
+    for (int i = 0; i < c->n; i++)
+      Set(table + Cells(c->keys[i] - min), c->addrs[i]);
+  } else {
+    for (int i = 0; i < c->n; i++) {
+      PutI(DUP);
+      PutI(LIT);
+      Put(c->keys[i]);
+      PutI(NEQ);
+      PutI(ZJMP);
+      PutK(c->addrs[i], CellAddr);
+    }
+  }
+  PutI(JMP);
+  PutK(deflt, CellAddr);
+
+  // back patch exits
+  for (Cell link = c->exits; link != 0;) {
+    Cell next = Get(link);
+    Set(link, ctx->here);
+    link = next;
+  }
+  clear_peephole(ctx);
+
+  ctx->cases = c->prev;
+  free(c->keys);
+  free(c->addrs);
+  free(c);
 }
 
 
@@ -662,13 +1892,13 @@ void handle_again(Context* ctx, Word* word) {
   Word* latest = ctx->current;
   if (!latest) die("Using again out of word");
   PutI(JMP);
-  Put(latest->inst);
+  PutK(latest->inst + (latest->locals ? Cells(2) : 0), CellAddr); // after ENTER
 }
 
 void handle_recur(Context* ctx, Word* word) {
   Word* latest = ctx->current;
   if (!latest) die("Using recur out of word");
-  Put(latest->inst);  
+  PutK(latest->inst, CellCall);
 }
 
 
@@ -714,7 +1944,7 @@ void handle_open_quot(Context* ctx, Word* word) {
   
   PutI(JMP);
   quot->back = ctx->here; // back patching addr
-  Put(0); // temporary
+  PutK(0, CellAddr); // temporary
   quot->inst = ctx->here;
 }
 
@@ -724,14 +1954,173 @@ void handle_close_quot(Context* ctx, Word* word) {
   Word* quot = ctx->current;
   if (!quot || quot->type != WordQuot)
     die_at(ctx, "Close quot out of quotation");
+  if (ctx->cases && ctx->cases->word == quot) die_at(ctx, "Unclosed CASE in quotation");
   ctx->current = quot->parent;
   
   PutI(RET);
   Set(quot->back, ctx->here);
+  ctx->quot = ctx->here;
   PutI(LIT);
-  Put(quot->inst);
-  
-  free(quot);
+  PutK(quot->inst, CellAddr);
+}
+
+
+/* ----- combinator inlining -----
+   A literal quotation followed by a combinator of core library
+   (FlagCombinator) is compiled into the caller without the quotation.
+     n [ B ] times  =>  n DO B LOOP
+     n [ B ] for    =>  n DO I B LOOP
+     a [ B ] dip    =>  a >r B r>
+     ? [ B ] ;IF    =>  ? IF B RET END
+   RET in B jumps to the end of B.
+   B is left as a quotation if it looks at the return stack
+   out of its own frame (FlagRet or FlagDeep callees, unbalanced r>)
+   or calls an unknown word (recur of itself or of the defining word).
+*/
+
+Cell literal_end(Context* ctx, Cell a, Cell end) {
+  // `jmp &x ... x: lit &(a+8)` of a string or a quotation: returns x + 8 or 0
+  VM* vm = ctx->vm;
+  if (Get(a) != Inst(JMP) || ctx->kinds[a / sizeof(Cell)] != CellCode) return 0;
+  Cell x = Get(a + Cells(1));
+  if (x <= a || x + Cells(2) > end) return 0;
+  if (Get(x) != Inst(LIT) || ctx->kinds[x / sizeof(Cell) + 1] != CellAddr) return 0;
+  return Get(x + Cells(1)) == a + Cells(2) ? x + Cells(2) : 0;
+}
+
+int inlinable_quot(Context* ctx, Cell begin, Cell end, Byte* rets) {
+  // rets[i] is set if the i-th cell is RET of the quotation itself
+  VM* vm = ctx->vm;
+  int depth = 0;
+
+  for (Cell a = begin; a < end; a += Cells(1)) {
+    Cell skip = literal_end(ctx, a, end);
+    if (skip) {
+      a = skip - Cells(1);
+      continue;
+    }
+    Cell v = Get(a);
+    switch (ctx->kinds[a / sizeof(Cell)]) {
+    case CellCall:
+      {
+        Word* callee = word_at(ctx, v);
+        if (!callee || (callee->flags & (FlagRet | FlagDeep))) return 0;
+        break;
+      }
+    case CellCode:
+      if (has_operand(v)) {
+        a += Cells(1);
+        break;
+      }
+      if (v == Inst(RET)) rets[(a - begin) / sizeof(Cell)] = 1;
+      if (v == Inst(RPUSH)) depth++;
+      if (v == Inst(RPOP) || v == Inst(RDROP)) depth--;
+      if (v == Inst(GETRP) || v == Inst(SETRP)) return 0;
+      if (depth < 0) return 0;
+      break;
+    default:
+      break;
+    }
+  }
+  return 1;
+}
+
+void relocate_vals(Context* ctx, Cell begin, Cell end, Cell* to) {
+  // update heads of val chains which point to moved links
+  for (Word* w = ctx->dict; w; w = w->child ? w->child : w->next) {
+    if (w->type != WordVal || w->back < begin || w->back >= end) continue;
+    w->back = to[(w->back - begin) / sizeof(Cell)];
+  }
+}
+
+void put_quot_body(Context* ctx, Cell begin, Cell* code, Byte* kinds, int* locs, Byte* rets, int n) {
+  // put cells of B moved from begin with RET replaced by jumps to its end
+  Cell* to = calloc(sizeof(Cell), n + 1);
+  if (!to) die("Can't allocate quotation");
+
+  Cell dest = ctx->here;
+  for (int i = 0; i < n; i++) {
+    to[i] = dest;
+    dest += Cells(rets[i] ? 2 : 1);
+  }
+  to[n] = dest;
+
+  Cell end = begin + Cells(n);
+  for (int i = 0; i < n; i++) {
+    Cell v    = code[i];
+    Byte kind = kinds[i];
+    if (rets[i]) {
+      PutI(JMP);
+      PutK(to[n], CellAddr);
+    } else {
+      int moved = (kind == CellCall || kind == CellAddr || kind == CellLink)
+        && v >= begin && v <= end;
+      PutK(moved ? to[(v - begin) / sizeof(Cell)] : v, kind);
+    }
+    // keep lines of the quotation
+    if (!locs) continue;
+    for (Cell a = to[i]; a < ctx->here; a += Cells(1))
+      ctx->locs[a / sizeof(Cell)] = locs[i];
+  }
+  relocate_vals(ctx, begin, end, to);
+  free(to);
+}
+
+int inline_combinator(Context* ctx, Word* word) {
+  // returns 0 if the last code is not an inlinable quotation
+  VM*  vm  = ctx->vm;
+  Cell lit = ctx->quot;
+  if (!lit || ctx->here != lit + Cells(2)) return 0;
+
+  Cell begin = Get(lit + Cells(1));
+  Cell end   = lit - Cells(1); // RET of the quotation
+  Cell jmp   = begin - Cells(2);
+  if (Get(jmp) != Inst(JMP) || Get(jmp + Cells(1)) != lit) return 0;
+
+  int   n     = (end - begin) / sizeof(Cell);
+  Cell* code  = calloc(sizeof(Cell), n + 1);
+  Byte* kinds = calloc(1, n + 1);
+  Byte* rets  = calloc(1, n + 1);
+  int*  locs  = ctx->locs ? calloc(sizeof(int), n + 1) : NULL;
+  if (!code || !kinds || !rets || (ctx->locs && !locs)) die("Can't allocate quotation");
+
+  int ok = inlinable_quot(ctx, begin, end, rets);
+  if (ok) {
+    for (int i = 0; i < n; i++) {
+      code[i]  = Get(begin + Cells(i));
+      kinds[i] = ctx->kinds[begin / sizeof(Cell) + i];
+      if (locs) locs[i] = ctx->locs[begin / sizeof(Cell) + i];
+    }
+    memset(ctx->kinds + jmp / sizeof(Cell), CellCode, (lit + Cells(2) - jmp) / sizeof(Cell));
+    ctx->here = jmp;
+    ctx->quot = 0;
+    clear_peephole(ctx);
+
+    char* name = word->name;
+    if (strcmp(name, "times") == 0 || strcmp(name, "for") == 0) {
+      handle_do(ctx, NULL);
+      if (strcmp(name, "for") == 0) handle_index(ctx, NULL);
+      put_quot_body(ctx, begin, code, kinds, locs, rets, n);
+      handle_loop(ctx, NULL);
+    } else if (strcmp(name, "dip") == 0) {
+      PutI(RPUSH);
+      put_quot_body(ctx, begin, code, kinds, locs, rets, n);
+      PutI(RPOP);
+    } else {
+      // ;IF
+      handle_if(ctx, NULL);
+      put_quot_body(ctx, begin, code, kinds, locs, rets, n);
+      if (ctx->current && ctx->current->locals) PutI(LEAVE);
+      PutI(RET);
+      handle_end(ctx, NULL);
+    }
+  }
+
+  free(code);
+  free(kinds);
+  free(rets);
+  free(locs);
+  return ok;
 }
 
 
@@ -745,19 +2134,21 @@ void handle_amp(Context* ctx) {
   // handle const
   if (found->type == WordConst)
     die_at(ctx, "Word %s is a constant. Do not use & for it.", found->name);
+  if (found->type == WordLocal)
+    die_at(ctx, "Word %s is a local. Do not use & for it.", found->name);
 
   // handle val
   if (found->type == WordVal) {
     PutI(LIT);
     Cell back = found->back;
     found->back = ctx->here;
-    Put(back);
+    PutK(back, CellLink);
     return;
   }
 
   // normal
   PutI(LIT);
-  Put(found->inst);
+  PutK(found->inst, found->type == WordPrim ? CellCode : CellAddr);
 }
 
 
@@ -808,85 +2199,766 @@ void fix_path(char* path) {
   }
 }
 
-char* path_in_dir(char* rel, char* fname) {
+char* path_in_dir(char* rel, char* fname) {
+#ifdef __MINGW32__
+  const char sep = '\\';
+#else
+  const char sep = '/';
+#endif
+
+  int flen = strlen(fname);
+  
+  char* full = full_path(rel);
+  char* dir = dirname(full);
+  int dlen = strlen(dir);
+  
+  int len = flen + 1 /* sep */ + dlen;
+  char* path = calloc(sizeof(char), len+1);
+  
+  memcpy(path, dir, dlen);
+  path[dlen] = sep;
+  memcpy(path+dlen+1, fname, flen);
+  path[len] = '\0';
+
+  free(full);
+  char* real = full_path(path);
+  free(path);
+  return real;
+}
+
+char* search_source(char* fname, char* rel) {
+  fix_path(rel);
+
+  char* full = path_in_dir(rel, fname);
+  if (full && access(full, F_OK) == 0) {
+    return full;
+  }
+  free(full);
+
+  char* lib = path_in_dir("lib/core.sol", fname); // if use "lib" you'll get parent of lib
+  if (lib && access (lib, F_OK) == 0) {
+    return lib;
+  }
+  free(lib);
+  
+  return NULL;
+}
+
+char* read_source_path(Context* ctx, char* desc, char** ret_fname) {
+  skip_spaces(ctx);
+
+  char* fname;
+  if (*ctx->p == '"') fname = read_include_path(ctx);
+  else die_at(ctx, "%s name required", desc);
+
+  char* path = search_source(fname, ctx->source_name);
+  if (!path) die_at(ctx, "%s not found: %s", desc, fname);
+
+  *ret_fname = fname;
+  return path;
+}
+
+Source* find_included(Context* ctx, char* path) {
+  Source* s = ctx->includes;
+  while (s) {
+    if (strcmp(s->fname, path) == 0) return s;
+    s = s->next;
+  }
+  return NULL;
+}
+
+int already_included(Context* ctx, char* path) {
+  Source* s = find_included(ctx, path);
+  if (!s) return 0;
+  if (s->compiling)
+    die_at(ctx, "Circular include detected on %s and %s", path, ctx->source_name);
+  return 1;
+}
+
+Source* add_included(Context* ctx, char* path) {
+  Source* s = calloc(sizeof(Source), 1);
+  s->fname = path;
+  s->next = ctx->includes;
+  ctx->includes = s;
+  return s;
+}
+
+
+/* ===== Include Cache =====
+   An include at toplevel is recorded as a unit while compiling:
+   its code with cell kinds, dictionary entries, val back patching chains,
+   names looked up out of the unit (imports)
+   and files read by the unit (dependencies).
+
+   The unit is saved to the cache directory keyed by hash of its path and text.
+   Next time the unit is spliced to current `here` with relocation instead of
+   compiling if all imports and dependencies are resolved in the same way.
+*/
+
+uint64_t hash_bytes(uint64_t h, const void* data, int len) {
+  // FNV-1a
+  const Byte* p = data;
+  for (int i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+uint64_t hash_str(uint64_t h, const char* s) {
+  return hash_bytes(h, s, strlen(s) + 1);
+}
+
+
+// ----- Buffer -----
+
+typedef struct Buffer {
+  Byte* data;
+  int   len;
+  int   cap;
+  int   pos; // reading position
+  int   err; // read over the end
+} Buffer;
+
+void buf_write(Buffer* b, const void* p, int len) {
+  if (b->len + len > b->cap) {
+    int cap = b->cap ? b->cap : 4096;
+    while (cap < b->len + len) cap *= 2;
+    b->data = realloc(b->data, cap);
+    if (!b->data) die("Can't allocate buffer");
+    b->cap = cap;
+  }
+  memcpy(b->data + b->len, p, len);
+  b->len += len;
+}
+
+void buf_cell(Buffer* b, Cell v) {
+  buf_write(b, &v, sizeof(Cell));
+}
+
+void buf_hash(Buffer* b, uint64_t v) {
+  buf_write(b, &v, sizeof(uint64_t));
+}
+
+void buf_str(Buffer* b, const char* s) {
+  Cell len = strlen(s);
+  buf_cell(b, len);
+  buf_write(b, s, len);
+}
+
+void buf_read(Buffer* b, void* p, int len) {
+  if (b->err || len < 0 || b->pos + len > b->len) {
+    b->err = 1;
+    memset(p, 0, len > 0 ? len : 0);
+    return;
+  }
+  memcpy(p, b->data + b->pos, len);
+  b->pos += len;
+}
+
+Cell buf_read_cell(Buffer* b) {
+  Cell v;
+  buf_read(b, &v, sizeof(Cell));
+  return v;
+}
+
+uint64_t buf_read_hash(Buffer* b) {
+  uint64_t v;
+  buf_read(b, &v, sizeof(uint64_t));
+  return v;
+}
+
+char* buf_read_str(Buffer* b) {
+  Cell len = buf_read_cell(b);
+  if (len < 0 || b->pos + len > b->len) {
+    b->err = 1;
+    return copy_str("");
+  }
+  char* s = calloc(sizeof(char), len + 1);
+  if (!s) die("Can't allocate string");
+  buf_read(b, s, len);
+  return s;
+}
+
+
+// ----- Unit -----
+
+typedef enum { DepInclude, DepSkip, DepData } DepKind;
+
+typedef struct Dep {
+  DepKind  kind;
+  char*    fname; // name written in source
+  char*    rel;   // source name searched from
+  char*    path;  // resolved path
+  uint64_t hash;  // hash of file contents
+  struct Dep* next;
+} Dep;
+
+typedef struct Import {
+  char* name;
+  Word* word;  // found word (NULL if not found)
+  int   type;  // type of found word or -1 if not found
+  int   flags;
+  Cell  inst;
+  Cell  head;  // newest link of imported val in unit
+  Cell  tail;  // oldest link of imported val in unit
+  uint64_t body; // hash of inlined code
+  struct Import* next;
+} Import;
+
+struct Unit {
+  uint64_t key;
+  Cell     begin;
+  int      serial;    // serial of the first word in unit
+  Word*    dict;      // toplevel dictionary before unit
+  int      cacheable;
+  Dep*     deps;
+  Import*  imports;
+  Unit*    parent;
+};
+
+#define NOT_FOUND -1
+
+uint64_t inline_hash(Context* ctx, Word* word) {
+  VM*  vm  = ctx->vm;
+  Cell end = inline_end(ctx, word);
+  uint64_t h = HASH_INIT;
+  for (Cell a = word->inst; a < end; a += Cells(1)) {
+    Byte kind = ctx->kinds[a / sizeof(Cell)];
+    Cell v    = kind == CellLink ? 0 : Get(a);
+    h = hash_bytes(h, &kind, 1);
+    h = hash_bytes(h, &v, sizeof(Cell));
+  }
+  return h;
+}
+
+void free_unit(Unit* u) {
+  Dep* d = u->deps;
+  while (d) {
+    Dep* next = d->next;
+    free(d->fname);
+    free(d->rel);
+    free(d->path);
+    free(d);
+    d = next;
+  }
+  Import* i = u->imports;
+  while (i) {
+    Import* next = i->next;
+    free(i->name);
+    free(i);
+    i = next;
+  }
+  free(u);
+}
+
+Dep* new_dep(DepKind kind, char* fname, char* rel, char* path, uint64_t hash) {
+  Dep* d = calloc(sizeof(Dep), 1);
+  if (!d) die("Can't allocate dependency");
+  d->kind  = kind;
+  d->fname = copy_str(fname);
+  d->rel   = copy_str(rel);
+  d->path  = copy_str(path);
+  d->hash  = hash;
+  return d;
+}
+
+void append_dep(Unit* u, Dep* dep) {
+  Dep** last = &u->deps;
+  while (*last) last = &(*last)->next;
+  *last = dep;
+}
+
+void record_dep(Context* ctx, DepKind kind, char* fname, char* rel, char* path, uint64_t hash) {
+  for (Unit* u = ctx->unit; u; u = u->parent)
+    append_dep(u, new_dep(kind, fname, rel, path, hash));
+}
+
+Import* find_import(Unit* u, char* name) {
+  for (Import* i = u->imports; i; i = i->next)
+    if (strcmp(i->name, name) == 0) return i;
+  return NULL;
+}
+
+void record_lookup(Context* ctx, char* name, Word* found) {
+  // record a name found out of units (or not found)
+  for (Unit* u = ctx->unit; u; u = u->parent) {
+    if (found && found->serial >= u->serial) continue; // in unit
+    if (find_import(u, name)) continue;
+
+    Import* i = calloc(sizeof(Import), 1);
+    if (!i) die("Can't allocate import");
+    i->name  = copy_str(name);
+    i->word  = found;
+    i->type  = found ? found->type  : NOT_FOUND;
+    i->flags = found ? found->flags : 0;
+    i->inst  = found ? found->inst  : 0;
+    i->body  = i->flags & FlagInline ? inline_hash(ctx, found) : 0;
+    i->next  = u->imports;
+    u->imports = i;
+  }
+}
+
+uint64_t unit_key(Context* ctx, char* path, char* text) {
+  // Already included files are also hashed
+  // not to overwrite each other by apps including the unit in other order.
+  Cell version = CACHE_VERSION;
+  uint64_t h = hash_bytes(HASH_INIT, &version, sizeof(Cell));
+  for (Source* s = ctx->includes; s; s = s->next) h = hash_str(h, s->fname);
+  h = hash_str(h, path);
+  return hash_str(h, text);
+}
+
+char* unit_file(Context* ctx, uint64_t key) {
+  int   len  = strlen(ctx->cache_dir) + 32;
+  char* name = calloc(sizeof(char), len);
+  if (!name) die("Can't allocate cache file name");
+  snprintf(name, len, "%s/%016llx.solu", ctx->cache_dir, (unsigned long long)key);
+  return name;
+}
+
+Unit* begin_unit(Context* ctx, uint64_t key) {
+  Unit* u = calloc(sizeof(Unit), 1);
+  if (!u) die("Can't allocate unit");
+  u->key       = key;
+  u->begin     = ctx->here;
+  u->serial    = ctx->serial + 1;
+  u->dict      = ctx->dict;
+  u->cacheable = 1;
+  u->parent    = ctx->unit;
+  ctx->unit    = u;
+  return u;
+}
+
+void uncache_units(Context* ctx) {
+  // code run at compile time depends on more than imports
+  for (Unit* u = ctx->unit; u; u = u->parent) u->cacheable = 0;
+}
+
+int in_unit(Unit* u, Cell end, Cell addr) {
+  // end is also in unit for jumping to next of the unit
+  return addr >= u->begin && addr <= end;
+}
+
+Import* import_at(Unit* u, Cell addr) {
+  // imported word which starts at addr
+  for (Import* i = u->imports; i; i = i->next) {
+    if (!i->word) continue;
+    if (i->type == WordUser || i->type == WordVal) {
+      if (i->inst == addr) return i;
+    }
+    if (i->type == WordConst && (i->flags & FlagData) && i->inst == addr) return i;
+  }
+  return NULL;
+}
+
+Import* import_tail_at(Unit* u, Cell addr) {
+  for (Import* i = u->imports; i; i = i->next)
+    if (i->tail == addr) return i;
+  return NULL;
+}
+
+int check_unit(Context* ctx, Unit* u) {
+  // whether all references out of unit are imports
+  VM*  vm  = ctx->vm;
+  Cell end = ctx->here;
+
+  // links of imported vals
+  for (Import* i = u->imports; i; i = i->next) {
+    if (!i->word || val_of(i->word)->type != WordVal) continue;
+    Cell link = val_of(i->word)->back;
+    while (in_unit(u, end, link)) {
+      if (!i->head) i->head = link;
+      i->tail = link;
+      link = Get(link);
+    }
+  }
+
+  for (Cell a = u->begin; a < end; a += sizeof(Cell)) {
+    Cell v = Get(a);
+    switch (ctx->kinds[a / sizeof(Cell)]) {
+    case CellCall:
+    case CellAddr:
+    case CellDataAddr:
+      if (in_unit(u, end, v)) break;
+      if (!import_at(u, v)) return 0;
+      break;
+    case CellLink:
+      if (v == 0 || in_unit(u, end, v)) break;
+      if (!import_tail_at(u, a)) return 0;
+      break;
+    default:
+      break;
+    }
+  }
+  return 1;
+}
+
+void write_words(Buffer* b, Word* word, Word* stop) {
+  // siblings (newest first) then their children
+  Cell n = 0;
+  for (Word* w = word; w && w != stop; w = w->next) n++;
+  buf_cell(b, n);
+
+  for (Word* w = word; w && w != stop; w = w->next) {
+    buf_cell(b, w->type);
+    buf_cell(b, w->flags);
+    buf_cell(b, w->level);
+    buf_cell(b, w->inst);
+    buf_cell(b, w->back);
+    buf_cell(b, w->end);
+    buf_str(b, w->name);
+  }
+
+  for (Word* w = word; w && w != stop; w = w->next)
+    write_words(b, w->child, w->next);
+}
+
+void write_unit(Context* ctx, Unit* u, Buffer* b) {
+  VM*  vm  = ctx->vm;
+  Cell end = ctx->here;
+
+  buf_write(b, "SOLU", 4);
+  buf_cell(b, CACHE_VERSION);
+  buf_hash(b, u->key);
+  buf_cell(b, u->begin);
+  buf_cell(b, end);
+  buf_write(b, vm->mem + u->begin, end - u->begin);
+  buf_write(b, ctx->kinds + u->begin / sizeof(Cell), (end - u->begin) / sizeof(Cell));
+
+  Cell n = 0;
+  for (Dep* d = u->deps; d; d = d->next) n++;
+  buf_cell(b, n);
+  for (Dep* d = u->deps; d; d = d->next) {
+    buf_cell(b, d->kind);
+    buf_str(b, d->fname);
+    buf_str(b, d->rel);
+    buf_str(b, d->path);
+    buf_hash(b, d->hash);
+  }
+
+  n = 0;
+  for (Import* i = u->imports; i; i = i->next) n++;
+  buf_cell(b, n);
+  for (Import* i = u->imports; i; i = i->next) {
+    buf_str(b, i->name);
+    buf_cell(b, i->type);
+    buf_cell(b, i->flags);
+    buf_cell(b, i->inst);
+    buf_cell(b, i->head);
+    buf_cell(b, i->tail);
+    buf_hash(b, i->body);
+  }
+
+  write_words(b, ctx->dict, u->dict);
+}
+
+void save_unit(Context* ctx, Unit* u) {
+  if (!u->cacheable || !check_unit(ctx, u)) return;
+
+  Buffer b = {0};
+  write_unit(ctx, u, &b);
+
 #ifdef __MINGW32__
-  const char sep = '\\';
+  mkdir(ctx->cache_dir);
 #else
-  const char sep = '/';
+  mkdir(ctx->cache_dir, 0755);
 #endif
 
-  int flen = strlen(fname);
-  
-  char* full = full_path(rel);
-  char* dir = dirname(full);
-  int dlen = strlen(dir);
-  
-  int len = flen + 1 /* sep */ + dlen;
-  char* path = calloc(sizeof(char), len+1);
-  
-  memcpy(path, dir, dlen);
-  path[dlen] = sep;
-  memcpy(path+dlen+1, fname, flen);
-  path[len] = '\0';
+  // write to temporary then rename for other sol processes
+  char* name = unit_file(ctx, u->key);
+  int   len  = strlen(name) + 16;
+  char* tmp  = calloc(sizeof(char), len);
+  snprintf(tmp, len, "%s.%d", name, (int)getpid());
+
+  FILE* file = fopen(tmp, "wb");
+  if (file) {
+    int ok = fwrite(b.data, 1, b.len, file) == b.len;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp, name) != 0) remove(tmp);
+  }
 
-  free(full);
-  char* real = full_path(path);
+  free(tmp);
+  free(name);
+  free(b.data);
+}
+
+void end_unit(Context* ctx, Unit* u) {
+  ctx->unit = u->parent;
+  save_unit(ctx, u);
+  free_unit(u);
+}
+
+
+// ----- Splicing -----
+
+int read_file_hash(char* path, uint64_t* hash) {
+  FILE* file = fopen(path, "rb");
+  if (!file) return 0;
+
+  uint64_t h = HASH_INIT;
+  Byte buf[4096];
+  int  n;
+  while ((n = fread(buf, 1, sizeof(buf), file)) > 0) h = hash_bytes(h, buf, n);
+  fclose(file);
+
+  *hash = h;
+  return 1;
+}
+
+char* search_source(char* fname, char* rel);
+
+int valid_dep(Context* ctx, Dep* d, Dep* pending) {
+  // pending: included files by previous deps of the unit
+  char* rel  = copy_str(d->rel);
+  char* path = search_source(d->fname, rel);
+  free(rel);
+  if (!path) return 0;
+  int same = strcmp(path, d->path) == 0;
   free(path);
-  return real;
+  if (!same) return 0;
+
+  int included = find_included(ctx, d->path) != NULL;
+  for (Dep* p = pending; p && p != d; p = p->next)
+    if (p->kind == DepInclude && strcmp(p->path, d->path) == 0) included = 1;
+
+  if (d->kind == DepSkip) {
+    Source* s = find_included(ctx, d->path);
+    return included && !(s && s->compiling);
+  }
+
+  if (d->kind == DepInclude && included) return 0;
+
+  uint64_t hash;
+  if (!read_file_hash(d->path, &hash)) return 0;
+  return hash == d->hash;
 }
 
-char* search_source(char* fname, char* rel) {
-  fix_path(rel);
+int valid_import(Context* ctx, Import* i) {
+  Word* found = find_word(ctx, i->name);
+  i->word = found;
+
+  if (i->type == NOT_FOUND) return found == NULL;
+  if (!found) return 0;
+  if (found->type  != i->type)  return 0;
+  if (found->flags != i->flags) return 0;
+
+  switch (i->type) {
+  case WordPrim:  return found->inst == i->inst;
+  case WordConst: return (i->flags & FlagData) || found->inst == i->inst;
+  case WordUser:
+  case WordVal:
+    return !(i->flags & FlagInline) || inline_hash(ctx, found) == i->body;
+  default:        return 0;
+  }
+}
 
-  char* full = path_in_dir(rel, fname);
-  if (full && access(full, F_OK) == 0) {
-    return full;
+Cell relocate(Unit* u, Cell end, Cell delta, Cell v) {
+  // returns 0 if v can't be relocated
+  if (in_unit(u, end, v)) return v + delta;
+  Import* i = import_at(u, v);
+  if (!i) return 0;
+  return i->word->inst;
+}
+
+int relocate_unit(Unit* u, Cell end, Cell delta, Cell* code, Byte* kinds) {
+  int n = (end - u->begin) / sizeof(Cell);
+  for (int c = 0; c < n; c++) {
+    Cell addr = u->begin + Cells(c);
+    switch (kinds[c]) {
+    case CellCall:
+    case CellAddr:
+    case CellDataAddr:
+      code[c] = relocate(u, end, delta, code[c]);
+      if (!code[c]) return 0;
+      break;
+    case CellLink:
+      {
+        Import* i = import_tail_at(u, addr);
+        if (i) {
+          code[c] = val_of(i->word)->back;
+        } else if (code[c] != 0) {
+          if (!in_unit(u, end, code[c])) return 0;
+          code[c] += delta;
+        }
+        break;
+      }
+    default:
+      break;
+    }
   }
-  free(full);
+  return 1;
+}
 
-  char* lib = path_in_dir("lib/core.sol", fname); // if use "lib" you'll get parent of lib
-  if (lib && access (lib, F_OK) == 0) {
-    return lib;
+WordHandler word_handler(Word* w) {
+  switch (w->type) {
+  case WordConst: return handle_const;
+  case WordLocal: return w->flags & FlagSetter ? handle_local_set : handle_local;
+  default:        return handle_inst;
   }
-  free(lib);
-  
-  return NULL;
 }
 
-char* read_source_path(Context* ctx, char* desc) {
-  skip_spaces(ctx);
+Word* read_words(Context* ctx, Buffer* b, Word* parent, Word* tail, Cell delta) {
+  // returns first of siblings or NULL
+  Cell n = buf_read_cell(b);
+  if (n <= 0 || n > b->len) return NULL;
+
+  Word** words = calloc(sizeof(Word*), n);
+  if (!words) die("Can't allocate words");
+
+  for (int i = 0; i < n; i++) {
+    Word* w = new_word(buf_read_cell(b));
+    w->flags = buf_read_cell(b);
+    w->level = buf_read_cell(b);
+    w->inst  = buf_read_cell(b);
+    w->back  = buf_read_cell(b);
+    w->end   = buf_read_cell(b);
+    char* name = buf_read_str(b);
+    w->name  = arena_str(name, strlen(name));
+    free(name);
+    note_name(ctx, w->name);
+    w->parent  = parent;
+    w->handler = word_handler(w);
+    w->serial  = ++ctx->serial;
+
+    int code = w->type == WordUser || w->type == WordVal || (w->flags & FlagData);
+    if (code) w->inst += delta;
+    if (w->back) w->back += delta;
+    if (w->end)  w->end  += delta;
+    words[i] = w;
+  }
 
-  char* fname;
-  if (*ctx->p == '"') fname = read_include_path(ctx);
-  else die_at(ctx, "%s name required", desc);
+  for (int i = 0; i < n; i++)
+    words[i]->next = i + 1 < n ? words[i+1] : tail;
 
-  char* path = search_source(fname, ctx->source_name);
-  if (!path) die_at(ctx, "%s not found: %s", desc, fname);
+  for (int i = 0; i < n; i++)
+    words[i]->child = read_words(ctx, b, words[i], words[i]->next, delta);
 
-  return path;
+  Word* first = words[0];
+  free(words);
+  return first;
 }
 
-int already_included(Context* ctx, char* path) {
-  Source* s = ctx->includes;
-  while (s) {
-    if (strcmp(s->fname, path) == 0) {
-      if (s->compiling)
-        die_at(ctx, "Circular include detected on %s and %s", path, ctx->source_name);
-      return 1;
-    }
-    s = s->next;
+int read_unit(Context* ctx, Buffer* b, Unit* u) {
+  // validate and splice the unit in buffer
+  VM*   vm = ctx->vm;
+  char  magic[4];
+  int   ok = 0;
+  Cell* code  = NULL;
+  Byte* kinds = NULL;
+
+  buf_read(b, magic, 4);
+  if (memcmp(magic, "SOLU", 4) != 0) return 0;
+  if (buf_read_cell(b) != CACHE_VERSION) return 0;
+  if (buf_read_hash(b) != u->key) return 0;
+
+  u->begin = buf_read_cell(b);
+  Cell end = buf_read_cell(b);
+  int size = end - u->begin;
+  if (b->err || size < 0 || size % sizeof(Cell) != 0) return 0;
+  if (!ark_valid_addr(vm, ctx->here + size)) return 0;
+
+  code  = calloc(1, size + sizeof(Cell));
+  kinds = calloc(1, size / sizeof(Cell) + 1);
+  if (!code || !kinds) die("Can't allocate unit");
+  buf_read(b, code, size);
+  buf_read(b, kinds, size / sizeof(Cell));
+
+  Cell n = buf_read_cell(b);
+  for (int i = 0; i < n && !b->err; i++) {
+    Dep* d = calloc(sizeof(Dep), 1);
+    d->kind  = buf_read_cell(b);
+    d->fname = buf_read_str(b);
+    d->rel   = buf_read_str(b);
+    d->path  = buf_read_str(b);
+    d->hash  = buf_read_hash(b);
+    append_dep(u, d);
   }
-  return 0;
+
+  n = buf_read_cell(b);
+  for (int i = 0; i < n && !b->err; i++) {
+    Import* imp = calloc(sizeof(Import), 1);
+    imp->name  = buf_read_str(b);
+    imp->type  = buf_read_cell(b);
+    imp->flags = buf_read_cell(b);
+    imp->inst  = buf_read_cell(b);
+    imp->head  = buf_read_cell(b);
+    imp->tail  = buf_read_cell(b);
+    imp->body  = buf_read_hash(b);
+    imp->next  = u->imports;
+    u->imports = imp;
+  }
+  if (b->err) goto done;
+
+  // ----- validate -----
+  for (Dep* d = u->deps; d; d = d->next)
+    if (!valid_dep(ctx, d, u->deps)) goto done;
+
+  for (Import* i = u->imports; i; i = i->next)
+    if (!valid_import(ctx, i)) goto done;
+
+  Cell delta = ctx->here - u->begin;
+  if (!relocate_unit(u, end, delta, code, kinds)) goto done;
+
+  // ----- splice -----
+  Word* first = read_words(ctx, b, NULL, ctx->dict, delta);
+  if (b->err) die("Broken cache of unit %016llx", (unsigned long long)u->key);
+  if (first) ctx->dict = first;
+
+  memcpy(vm->mem + ctx->here, code, size);
+  memcpy(ctx->kinds + ctx->here / sizeof(Cell), kinds, size / sizeof(Cell));
+
+  for (Import* i = u->imports; i; i = i->next)
+    if (i->head) val_of(i->word)->back = i->head + delta;
+
+  ctx->here += size;
+  ok = 1;
+
+ done:
+  free(code);
+  free(kinds);
+  return ok;
 }
 
-Source* add_included(Context* ctx, char* path) {
-  Source* s = calloc(sizeof(Source), 1);
-  s->fname = path;
-  s->next = ctx->includes;
-  ctx->includes = s;
-  return s;
+int load_unit(Context* ctx, uint64_t key) {
+  // returns whether the unit is spliced from cache
+  char* name = unit_file(ctx, key);
+  FILE* file = fopen(name, "rb");
+  free(name);
+  if (!file) return 0;
+
+  Buffer b = {0};
+  Byte chunk[4096];
+  int  n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) buf_write(&b, chunk, n);
+  fclose(file);
+
+  Unit* u = calloc(sizeof(Unit), 1);
+  if (!u) die("Can't allocate unit");
+  u->key = key;
+
+  // do not record lookups while validating
+  Unit* recording = ctx->unit;
+  ctx->unit = NULL;
+  int ok = read_unit(ctx, &b, u);
+  ctx->unit = recording;
+
+  if (ok) {
+    // register includes and pass dependencies to outer units
+    for (Dep* d = u->deps; d; d = d->next) {
+      if (d->kind == DepInclude) add_included(ctx, copy_str(d->path));
+      record_dep(ctx, d->kind, d->fname, d->rel, d->path, d->hash);
+    }
+    for (Import* i = u->imports; i; i = i->next)
+      record_lookup(ctx, i->name, i->word);
+  }
+
+  free_unit(u);
+  free(b.data);
+  return ok;
 }
 
+
 void handle_include(Context* ctx, Word* word) {
   skip_spaces(ctx);
 
@@ -898,6 +2970,7 @@ void handle_include(Context* ctx, Word* word) {
   if (!path) die_at(ctx, "include: not found: %s", fname);
 
   if (already_included(ctx, path)) {
+    record_dep(ctx, DepSkip, fname, ctx->source_name, path, 0);
     free(path);
     return;
   }
@@ -906,18 +2979,92 @@ void handle_include(Context* ctx, Word* word) {
   s->compiling = 1; // for circular compiling
  
   char* src = read_source(path);
-  char* old_p      = ctx->p;
-  char* old_source = ctx->source_name;
+  record_dep(ctx, DepInclude, fname, ctx->source_name, path, hash_bytes(HASH_INIT, src, strlen(src)));
+
+  // only toplevel includes are cached
+  int   cache = ctx->cache_dir && !ctx->current;
+  uint64_t key = cache ? unit_key(ctx, path, src) : 0;
+
+  if (!(cache && load_unit(ctx, key))) {
+    char* old_p      = ctx->p;
+    char* old_source = ctx->source_name;
+    Unit* unit       = cache ? begin_unit(ctx, key) : NULL;
+
+    ctx->p = src;
+    ctx->source_name = fname;
+    compile_source(ctx);
+    ctx->p = old_p;
+    ctx->source_name = old_source;
 
-  ctx->p = src;
-  ctx->source_name = fname;
-  compile_source(ctx);
-  ctx->p = old_p;
-  ctx->source_name = old_source;
+    if (unit) end_unit(ctx, unit);
+  }
 
   s->compiling = 0;
+  clear_peephole(ctx);
   // DO NOT FREE PATH, It is used for included list
-  free(src);
+}
+
+
+/* ===== Core Library Snapshot =====
+   bin/sol does not compile lib/core.sol at every run.
+   The build compiles it once by stage0 sol (built with SOL_NO_SNAPSHOT)
+   and writes the unit of it to core.snap.h by --snapshot.
+   The unit is spliced at the beginning of code like a cached include.
+*/
+
+#define CORE_NAME "core library"
+
+void add_corelib(Context* ctx) {
+#if defined(SOL_NO_SNAPSHOT)
+  add_source(ctx, CORE_NAME, arena_str(core_lib, strlen(core_lib)));
+#else
+  if (ctx->here != ARK_ADDR_CODE_BEGIN) die("Core library should be loaded first");
+
+  Buffer b = { .data = core_snapshot, .len = sizeof(core_snapshot) };
+  Unit*  u = calloc(sizeof(Unit), 1);
+  if (!u) die("Can't allocate unit");
+  u->key = CORE_SNAPSHOT_KEY;
+  if (!read_unit(ctx, &b, u)) die("Broken core library snapshot");
+  free_unit(u);
+#endif
+}
+
+void mark_combinators(Context* ctx) {
+  // combinators which inline literal quotations (snapshot keeps the flag)
+  char* names[] = { "times", "for", "dip", ";IF" };
+  for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+    Word* w = find_word(ctx, names[i]);
+    if (w && w->type == WordUser) w->flags |= FlagCombinator;
+  }
+}
+
+uint64_t core_key() {
+#if defined(SOL_NO_SNAPSHOT)
+  return hash_str(hash_str(HASH_INIT, CORE_NAME), core_lib);
+#else
+  return CORE_SNAPSHOT_KEY;
+#endif
+}
+
+void save_snapshot(Context* ctx, char* fname) {
+  // whole code and dictionary should be of core library
+  Unit u = { .key = core_key(), .begin = ARK_ADDR_CODE_BEGIN };
+  if (!check_unit(ctx, &u)) die("Core library refers out of itself");
+
+  Buffer b = {0};
+  write_unit(ctx, &u, &b);
+
+  FILE* file = open_file("snapshot", fname, "w");
+  fprintf(file, "/* This file is generated by sol --snapshot. DO NOT EDIT */\n\n");
+  fprintf(file, "#define CORE_SNAPSHOT_KEY 0x%016llxULL\n\n", (unsigned long long)u.key);
+  fprintf(file, "Byte core_snapshot[] = {");
+  for (int i = 0; i < b.len; i++) {
+    if (i % 16 == 0) fprintf(file, "\n  ");
+    fprintf(file, "0x%02x,", b.data[i]);
+  }
+  fprintf(file, "\n};\n");
+  if (fclose(file) != 0) die("%s(snapshot): %s", strerror(errno), fname);
+  free(b.data);
 }
 
 
@@ -934,15 +3081,26 @@ void handle_datafile(Context* ctx, Word* word) {
   Word* entry = create_dict_entry(ctx, ctx->token_buf);
 
   entry->type    = WordConst;
+  entry->flags   = FlagData;
   entry->handler = handle_const;
   entry->inst    = ctx->here;
 
   /* read file name */
   Cell size_addr = ctx->here;
-  Put(0);
-  char* path = read_source_path(ctx, "datafile:");
+  PutK(0, CellData);
+  char* fname;
+  char* path = read_source_path(ctx, "datafile:", &fname);
   Cell size = read_blob(vm, ctx->here, path);
-  ctx->here = align(ctx->here + size);
+  if (ctx->unit) {
+    uint64_t hash = hash_bytes(HASH_INIT, vm->mem + ctx->here, size);
+    record_dep(ctx, DepData, fname, ctx->source_name, path, hash);
+  }
+  free(fname);
+  Cell end  = align(ctx->here + size);
+  for (Cell a = ctx->here; a < end; a += sizeof(Cell))
+    ctx->kinds[a / sizeof(Cell)] = CellData;
+  ctx->here  = end;
+  entry->end = end;
   Set(size_addr, size);
 
   close_nest(ctx);  
@@ -1012,9 +3170,24 @@ Word word_table[] =
     PrimOf(";",      handle_semicolon),
     PrimOf("const:", handle_defconst),
     PrimOf("val:",   handle_defval),
+    PrimOf("local:", handle_deflocal),
+    PrimOf("data:",  handle_defdata),
+    PrimOf("inline:", handle_definline),
     PrimOf("IF",     handle_if),
     PrimOf("ELSE",   handle_else),
     PrimOf("END",    handle_end),
+    PrimOf("DO",     handle_do),
+    PrimOf("LOOP",   handle_loop),
+    PrimOf("I",      handle_index),
+    PrimOf("J",      handle_outer_index),
+    PrimOf("BEGIN",  handle_begin),
+    PrimOf("WHILE",  handle_while),
+    PrimOf("REPEAT", handle_repeat),
+    PrimOf("UNTIL",  handle_until),
+    PrimOf("CASE",   handle_case),
+    PrimOf("OF",     handle_of),
+    PrimOf("ENDOF",  handle_endof),
+    PrimOf("ENDCASE", handle_endcase),
     PrimOf("AGAIN",  handle_again),
     PrimOf("RECUR",  handle_recur),
     PrimOf("#",      handle_comment),
@@ -1098,10 +3271,11 @@ Word* find_word(Context* ctx, char* name) {
   */
   Word* cur = ctx->current;
   ctx->search_level = 0;
-  if (cur)
-    return find_word_from(ctx, cur->child ? cur->child : cur->next, name);
-  
-  return find_word_from(ctx, ctx->dict, name);
+  Word* start = cur ? (cur->child ? cur->child : cur->next) : ctx->dict;
+  Word* found = find_word_from(ctx, maybe_in_dict(ctx, name) ? start : NULL, name);
+
+  if (ctx->unit) record_lookup(ctx, name, found);
+  return found;
 }
 
 
@@ -1176,7 +3350,7 @@ int compile_string(Context* ctx) {
   
   PutI(JMP);
   Cell back = ctx->here;
-  Put(0); // temporary
+  PutK(0, CellAddr); // temporary
   Cell str = ctx->here;
 
   char c = *ctx->p;
@@ -1210,17 +3384,28 @@ int compile_string(Context* ctx) {
 
   Set(back, ctx->here); // back patch
   PutI(LIT);
-  Put(str);
+  PutK(str, CellAddr);
   return 1;
 }
 
 
 void compile_source(Context* ctx) {
+  // lines are counted in each source (include: compiles nested)
+  char* line_p = ctx->line_p;
+  int   line   = ctx->line;
+  ctx->line_p = ctx->p;
+  ctx->line   = 1;
+
+  clear_peephole(ctx);
   while (*ctx->p != '\0') {
     skip_spaces(ctx);
+    mark_loc(ctx);
     if (compile_string(ctx)) continue;
     compile_token(ctx);
   }
+
+  ctx->line_p = line_p;
+  ctx->line   = line;
 }
 
 void compile_all(Context* ctx) {
@@ -1229,6 +3414,7 @@ void compile_all(Context* ctx) {
     ctx->p = ctx->source->text;
     ctx->source_name = ctx->source->fname;
     compile_source(ctx);
+    if (strcmp(ctx->source->fname, CORE_NAME) == 0) mark_combinators(ctx);
     Source* src = ctx->source;
     ctx->source = ctx->source->next;
     free_source(src);
@@ -1236,6 +3422,485 @@ void compile_all(Context* ctx) {
 }
 
 
+// Tree Shaking
+// =============================================================================
+
+/* Code is split into blocks: ranges of words [inst, end)
+   and gaps between them (entrypoint, code out of words).
+   Blocks reachable from gaps through calls and addresses (&word, quotations,
+   jumps, strings and datafile) are kept and moved to close up the others.
+   Val links in dropped blocks are removed from back patching chains.
+   With a profile, blocks are also reordered (see Profile-guided Layout).
+*/
+
+typedef struct Block {
+  Cell     begin;
+  Cell     end;
+  Cell     dest; // new address
+  int      live;
+  int      word;
+  uint64_t count; // calls in profile
+} Block;
+
+int has_code(Word* w) {
+  return w->end != 0 && w->end > w->inst;
+}
+
+int compare_block(const void* a, const void* b) {
+  return ((Block*)a)->begin - ((Block*)b)->begin;
+}
+
+Block* collect_blocks(Context* ctx, int* ret_n) {
+  int n = 0;
+  for (Word* w = ctx->dict; w; w = w->child ? w->child : w->next)
+    if (has_code(w)) n++;
+
+  Block* words = calloc(sizeof(Block), n + 1);
+  if (!words) die("Can't allocate blocks");
+  n = 0;
+  for (Word* w = ctx->dict; w; w = w->child ? w->child : w->next) {
+    if (!has_code(w)) continue;
+    words[n].begin = w->inst;
+    words[n].end   = w->end;
+    words[n].word  = 1;
+    n++;
+  }
+  qsort(words, n, sizeof(Block), compare_block);
+
+  // fill gaps as live blocks
+  Block* blocks = calloc(sizeof(Block), n * 2 + 1);
+  if (!blocks) die("Can't allocate blocks");
+  int  len  = 0;
+  Cell here = ARK_ADDR_CODE_BEGIN;
+  for (int i = 0; i < n; i++) {
+    if (words[i].begin < here) die("Overlapped words at %d", words[i].begin);
+    if (words[i].begin > here)
+      blocks[len++] = (Block){ .begin = here, .end = words[i].begin, .live = 1 };
+    blocks[len++] = words[i];
+    here = words[i].end;
+  }
+  if (here < ctx->here)
+    blocks[len++] = (Block){ .begin = here, .end = ctx->here, .live = 1 };
+
+  free(words);
+  *ret_n = len;
+  return blocks;
+}
+
+Block* block_at(Block* blocks, int n, Cell addr) {
+  int lo = 0;
+  int hi = n - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if      (addr <  blocks[mid].begin) hi = mid - 1;
+    else if (addr >= blocks[mid].end)   lo = mid + 1;
+    else return &blocks[mid];
+  }
+  return NULL;
+}
+
+int is_ref(Byte kind) {
+  return kind == CellCall || kind == CellAddr || kind == CellDataAddr;
+}
+
+void mark_blocks(Context* ctx, Block* blocks, int n) {
+  VM* vm = ctx->vm;
+  int* stack = calloc(sizeof(int), n);
+  if (!stack) die("Can't allocate block stack");
+  int sp = 0;
+  for (int i = 0; i < n; i++)
+    if (blocks[i].live) stack[sp++] = i;
+
+  while (sp > 0) {
+    Block* b = &blocks[stack[--sp]];
+    for (Cell a = b->begin; a < b->end; a += Cells(1)) {
+      if (!is_ref(ctx->kinds[a / sizeof(Cell)])) continue;
+      Block* to = block_at(blocks, n, Get(a));
+      if (!to) die("Reference to out of code at %d", a);
+      if (to->live) continue;
+      to->live = 1;
+      stack[sp++] = to - blocks;
+    }
+  }
+  free(stack);
+}
+
+Cell moved(Block* blocks, int n, Cell addr) {
+  Block* b = block_at(blocks, n, addr);
+  return b->dest + (addr - b->begin);
+}
+
+void relink_val(Context* ctx, Word* val, Block* blocks, int n) {
+  // rebuild back patching chain with links in live blocks
+  VM*  vm   = ctx->vm;
+  Cell link = val->back;
+  Cell head = 0;
+  Cell prev = 0; // previous live link (old address)
+  while (link != 0) {
+    Cell next = Get(link);
+    if (block_at(blocks, n, link)->live) {
+      if (prev) Set(prev, moved(blocks, n, link));
+      else      head = moved(blocks, n, link);
+      prev = link;
+    }
+    link = next;
+  }
+  if (prev) Set(prev, 0);
+  val->back = head;
+}
+
+int* layout_order(Context* ctx, Block* blocks, int n);
+
+void shake(Context* ctx) {
+  VM* vm = ctx->vm;
+  int n;
+  Block* blocks = collect_blocks(ctx, &n);
+  if (ctx->shake) mark_blocks(ctx, blocks, n);
+  else for (int i = 0; i < n; i++) blocks[i].live = 1;
+
+  int* order = layout_order(ctx, blocks, n);
+  Cell dest  = ARK_ADDR_CODE_BEGIN;
+  for (int k = 0; k < n; k++) {
+    Block* b = &blocks[order[k]];
+    if (!b->live) continue;
+    b->dest = dest;
+    dest += b->end - b->begin;
+  }
+  free(order);
+
+  // relocate in place then move
+  for (Word* w = ctx->dict; w; w = w->child ? w->child : w->next)
+    if (w->type == WordVal) relink_val(ctx, w, blocks, n);
+
+  for (int i = 0; i < n; i++) {
+    Block* b = &blocks[i];
+    if (!b->live) continue;
+    for (Cell a = b->begin; a < b->end; a += Cells(1))
+      if (is_ref(ctx->kinds[a / sizeof(Cell)])) Set(a, moved(blocks, n, Get(a)));
+  }
+
+  // blocks may be reordered, so they are copied via new buffers
+  int   cells = ctx->here / sizeof(Cell);
+  Byte* mem   = calloc(sizeof(Byte), ctx->here);
+  Byte* kinds = calloc(sizeof(Byte), cells);
+  int*  locs  = calloc(sizeof(int), cells);
+  if (!mem || !kinds || !locs) die("Can't allocate blocks");
+  for (int i = 0; i < n; i++) {
+    Block* b = &blocks[i];
+    if (!b->live) continue;
+    int c   = b->begin / sizeof(Cell);
+    int to  = b->dest / sizeof(Cell);
+    int len = (b->end - b->begin) / sizeof(Cell);
+    memcpy(mem + b->dest, vm->mem + b->begin, b->end - b->begin);
+    memcpy(kinds + to, ctx->kinds + c, len);
+    if (ctx->locs) memcpy(locs + to, ctx->locs + c, len * sizeof(int));
+  }
+  memcpy(vm->mem + ARK_ADDR_CODE_BEGIN, mem + ARK_ADDR_CODE_BEGIN, ctx->here - ARK_ADDR_CODE_BEGIN);
+  memcpy(ctx->kinds, kinds, cells);
+  if (ctx->locs) memcpy(ctx->locs, locs, cells * sizeof(int));
+  free(mem);
+  free(kinds);
+  free(locs);
+
+  // dropped words have no code
+  for (Word* w = ctx->dict; w; w = w->child ? w->child : w->next) {
+    if (!has_code(w)) continue;
+    Block* b = block_at(blocks, n, w->inst);
+    if (b->live) {
+      w->end  = moved(blocks, n, w->inst) + (w->end - w->inst);
+      w->inst = moved(blocks, n, w->inst);
+    } else {
+      w->inst = 0;
+      w->end  = 0;
+    }
+  }
+
+  ctx->start = moved(blocks, n, ctx->start);
+  ctx->here  = dest;
+  free(blocks);
+}
+
+
+// Profile-guided Layout
+// =============================================================================
+
+/* `sol -p PROFILE` lays out words by call counts of `arkam -p`
+   (lines of `COUNT NAME`, NAME is full name of a word).
+     gaps (entrypoint ...) | called words by count | others in source order
+   So hot words are close to each other and
+   words never called in the profile (panic, error handlers ...) are at the end.
+   Without a profile, blocks are in source order.
+*/
+
+void read_profile(Context* ctx, Block* blocks, int n) {
+  FILE* file = open_file("profile", ctx->profile_name, "r");
+  char line[1024];
+  while (fgets(line, sizeof(line), file)) {
+    unsigned long long count;
+    char name[1024];
+    if (sscanf(line, "%llu %1023s", &count, name) != 2) continue;
+    Word* w = find_word(ctx, name);
+    if (!w || w->type == WordPrim || !has_code(w)) continue; // renamed or dropped
+    Block* b = block_at(blocks, n, w->inst);
+    if (b && b->word && b->begin == w->inst) b->count += count;
+  }
+  fclose(file);
+}
+
+Block* sorting_blocks; // for qsort
+
+int compare_layout(const void* a, const void* b) {
+  Block* x = &sorting_blocks[*(int*)a];
+  Block* y = &sorting_blocks[*(int*)b];
+  int rank_x = !x->word ? 0 : x->count ? 1 : 2;
+  int rank_y = !y->word ? 0 : y->count ? 1 : 2;
+  if (rank_x != rank_y) return rank_x - rank_y;
+  if (x->count != y->count) return x->count > y->count ? -1 : 1;
+  return x->begin < y->begin ? -1 : x->begin > y->begin;
+}
+
+int* layout_order(Context* ctx, Block* blocks, int n) {
+  // indexes of blocks in new order
+  int* order = calloc(sizeof(int), n + 1);
+  if (!order) die("Can't allocate blocks");
+  for (int i = 0; i < n; i++) order[i] = i;
+  if (!ctx->profile_name) return order;
+
+  read_profile(ctx, blocks, n);
+  sorting_blocks = blocks;
+  qsort(order, n, sizeof(int), compare_layout);
+  return order;
+}
+
+
+// Data Section
+// =============================================================================
+
+/* Strings, datafile and data: are moved out of code to the data section
+   placed after the code. Identical strings are put only once,
+   so they should not be modified.
+   A string `jmp &after [string...] (after) lit &str` becomes `lit &str`.
+*/
+
+typedef struct DataItem {
+  Cell     begin;
+  Cell     end;
+  Cell     dest;
+  uint64_t hash;
+  int      string; // only strings are shared
+} DataItem;
+
+int string_at(Context* ctx, Cell a, Cell* ret_end) {
+  // returns whether a string (jmp &end [data...] lit &data) is at a
+  VM*   vm  = ctx->vm;
+  Byte* k   = ctx->kinds;
+  Cell  str = a + Cells(2);
+  if (str >= ctx->here) return 0;
+  if (k[a / sizeof(Cell)] != CellCode || Get(a) != Inst(JMP)) return 0;
+  if (k[a / sizeof(Cell) + 1] != CellAddr) return 0;
+
+  Cell end = Get(a + Cells(1));
+  if (end <= str || end + Cells(2) > ctx->here) return 0;
+  for (Cell i = str; i < end; i += Cells(1))
+    if (k[i / sizeof(Cell)] != CellData) return 0;
+  if (k[end / sizeof(Cell)] != CellCode || Get(end) != Inst(LIT)) return 0;
+  if (k[end / sizeof(Cell) + 1] != CellAddr || Get(end + Cells(1)) != str) return 0;
+  *ret_end = end;
+  return 1;
+}
+
+Cell data_dest(Context* ctx, DataItem* items, int n, Cell here) {
+  // dest of the last item, shared with an identical previous one
+  VM* vm = ctx->vm;
+  DataItem* d = &items[n];
+  Cell len = d->end - d->begin;
+  if (!d->string) return here;
+  d->hash = hash_bytes(HASH_INIT, vm->mem + d->begin, len);
+  for (int i = 0; i < n; i++) {
+    DataItem* o = &items[i];
+    if (!o->string || o->hash != d->hash || o->end - o->begin != len) continue;
+    if (memcmp(vm->mem + o->begin, vm->mem + d->begin, len) == 0) return o->dest;
+  }
+  return here;
+}
+
+int is_data(Byte kind) {
+  return kind == CellData || kind == CellDataAddr;
+}
+
+Cell relocated(Context* ctx, Cell* to, Cell addr) {
+  if (addr < ARK_ADDR_CODE_BEGIN || addr > ctx->here) die("Reference to out of code: %d", addr);
+  return to[addr / sizeof(Cell)] + addr % sizeof(Cell);
+}
+
+void split_data(Context* ctx) {
+  VM* vm = ctx->vm;
+  int cells = ctx->here / sizeof(Cell);
+  Cell*     to    = calloc(sizeof(Cell), cells + 1); // new address of each cell
+  DataItem* items = calloc(sizeof(DataItem), cells);
+  if (!to || !items) die("Can't allocate data section");
+
+  // new addresses of code, removed jumps go to the next code
+  int  n    = 0;
+  Cell dest = ARK_ADDR_CODE_BEGIN;
+  Cell a    = ARK_ADDR_CODE_BEGIN;
+  while (a < ctx->here) {
+    Cell end;
+    if (string_at(ctx, a, &end)) {
+      to[a / sizeof(Cell)]     = dest;
+      to[a / sizeof(Cell) + 1] = dest;
+      items[n++] = (DataItem){ .begin = a + Cells(2), .end = end, .string = 1 };
+      a = end;
+      continue;
+    }
+    if (is_data(ctx->kinds[a / sizeof(Cell)])) {
+      // datafile and data:
+      end = a;
+      while (end < ctx->here && is_data(ctx->kinds[end / sizeof(Cell)])) end += Cells(1);
+      items[n++] = (DataItem){ .begin = a, .end = end };
+      a = end;
+      continue;
+    }
+    to[a / sizeof(Cell)] = dest;
+    dest += Cells(1);
+    a    += Cells(1);
+  }
+  Cell code_end = dest;
+  to[cells] = code_end;
+
+  // data section
+  for (int i = 0; i < n; i++) {
+    DataItem* d = &items[i];
+    d->dest = data_dest(ctx, items, i, dest);
+    if (d->dest == dest) dest += d->end - d->begin;
+    for (Cell c = d->begin; c < d->end; c += Cells(1))
+      to[c / sizeof(Cell)] = d->dest + (c - d->begin);
+  }
+
+  // relocate and build new image
+  Cell  size = dest;
+  Byte* mem   = calloc(sizeof(Byte), ctx->here);
+  Byte* kinds = calloc(sizeof(Byte), cells);
+  int*  locs  = calloc(sizeof(int), cells);
+  if (!mem || !kinds || !locs) die("Can't allocate data section");
+  a = ARK_ADDR_CODE_BEGIN;
+  while (a < ctx->here) {
+    Cell end;
+    if (string_at(ctx, a, &end)) {
+      a += Cells(2); // drop jump
+      continue;
+    }
+    int  i    = a / sizeof(Cell);
+    Byte kind = ctx->kinds[i];
+    Cell v    = Get(a);
+    if (is_ref(kind) || (kind == CellLink && v)) v = relocated(ctx, to, v);
+    memcpy(mem + to[i], &v, sizeof(Cell));
+    kinds[to[i] / sizeof(Cell)] = kind;
+    if (ctx->locs) locs[to[i] / sizeof(Cell)] = ctx->locs[i];
+    a += Cells(1);
+  }
+  memcpy(vm->mem + ARK_ADDR_CODE_BEGIN, mem + ARK_ADDR_CODE_BEGIN, size - ARK_ADDR_CODE_BEGIN);
+  memcpy(ctx->kinds, kinds, size / sizeof(Cell));
+  memset(vm->mem + size, 0, ctx->here - size);
+  memset(ctx->kinds + size / sizeof(Cell), 0, cells - size / sizeof(Cell));
+  if (ctx->locs) memcpy(ctx->locs, locs, sizeof(int) * cells);
+
+  for (Word* w = ctx->dict; w; w = w->child ? w->child : w->next) {
+    if (w->type == WordVal && w->back) w->back = relocated(ctx, to, w->back);
+    if (!has_code(w)) continue;
+    Cell last = relocated(ctx, to, w->end - Cells(1));
+    w->inst = relocated(ctx, to, w->inst);
+    w->end  = last + Cells(1);
+  }
+
+  ctx->start = relocated(ctx, to, ctx->start);
+  ctx->here  = size;
+  free(to);
+  free(items);
+  free(mem);
+  free(kinds);
+  free(locs);
+}
+
+
+// Symbols
+// =============================================================================
+
+/* `sol -m FILE` writes a text file of symbols for profilers and debuggers.
+     word BEGIN END NAME    code of NAME is [BEGIN, END)
+     line ADDR LINE FILE    code from ADDR is compiled from FILE:LINE
+     line ADDR 0 -          code from ADDR is of unknown lines
+   Addresses are hex and of the saved image.
+   NAME is full name of nested words (ex. ecs:new:find).
+   LINE is 1-origin.
+   Code spliced from the cache or the core snapshot has no lines.
+*/
+
+void enable_symbols(Context* ctx, char* fname) {
+  ctx->symbols_name = fname;
+  ctx->locs = calloc(sizeof(int), ctx->vm->cells);
+  ctx->loc_cap = 256;
+  ctx->loc_table = calloc(sizeof(Loc), ctx->loc_cap);
+  if (!ctx->locs || !ctx->loc_table) die("Can't allocate symbols");
+  ctx->loc_n = 1; // unknown
+}
+
+void mark_loc(Context* ctx) {
+  // set location of the token at ctx->p
+  if (!ctx->locs) return;
+  for (; ctx->line_p < ctx->p; ctx->line_p++)
+    if (*ctx->line_p == '\n') ctx->line++;
+
+  Loc* last = &ctx->loc_table[ctx->loc_n - 1];
+  if (ctx->loc_n > 1 && last->line == ctx->line
+      && strcmp(last->fname, ctx->source_name) == 0) {
+    ctx->loc = ctx->loc_n - 1;
+    return;
+  }
+  if (ctx->loc_n == ctx->loc_cap) {
+    ctx->loc_cap *= 2;
+    ctx->loc_table = realloc(ctx->loc_table, sizeof(Loc) * ctx->loc_cap);
+    if (!ctx->loc_table) die("Can't allocate symbols");
+  }
+  Loc* loc = &ctx->loc_table[ctx->loc_n];
+  loc->fname = ctx->loc_n > 1 && strcmp(last->fname, ctx->source_name) == 0
+    ? last->fname : copy_str(ctx->source_name);
+  loc->line  = ctx->line;
+  ctx->loc   = ctx->loc_n++;
+}
+
+void write_words_symbols(FILE* file, Word* word, int level, char* prefix) {
+  // words of the level (children continue to the next of their parent)
+  for (Word* w = word; w && w->level >= level; w = w->next) {
+    if (w->level > level) continue;
+    char* name = calloc(sizeof(char), strlen(prefix) + strlen(w->name) + 2);
+    if (!name) die("Can't allocate symbols");
+    sprintf(name, "%s%s", prefix, w->name);
+    if (has_code(w)) fprintf(file, "word 0x%08x 0x%08x %s\n", w->inst, w->end, name);
+    if (w->child) {
+      sprintf(name, "%s%s%c", prefix, w->name, NEST_SEPARATOR);
+      write_words_symbols(file, w->child, level + 1, name);
+    }
+    free(name);
+  }
+}
+
+void save_symbols(Context* ctx) {
+  FILE* file = open_file("symbols", ctx->symbols_name, "w");
+  write_words_symbols(file, ctx->dict, 0, "");
+
+  int last = -1;
+  for (Cell a = ARK_ADDR_CODE_BEGIN; a < ctx->here; a += Cells(1)) {
+    int i = ctx->locs[a / sizeof(Cell)];
+    if (i == last) continue;
+    last = i;
+    if (i == 0) fprintf(file, "line 0x%08x 0 -\n", a);
+    else fprintf(file, "line 0x%08x %d %s\n", a, ctx->loc_table[i].line, ctx->loc_table[i].fname);
+  }
+  if (fclose(file) != 0) die("%s(symbols): %s", strerror(errno), ctx->symbols_name);
+}
+
+
 // Setup and Entrypoint
 // =============================================================================
 
@@ -1252,11 +3917,31 @@ void setup_all(Context* ctx) {
   ctx->token_buf = calloc(sizeof(char), TOKEN_BUF_LEN+1); // for null termination
   if (!ctx->token_buf) die("Can't allocate token buffer");
 
+  ctx->kinds = calloc(sizeof(Byte), vm->cells);
+  if (!ctx->kinds) die("Can't allocate cell kinds");
+
   ctx->dict = NULL;
   ctx->current = NULL;
   ctx->source = NULL;
   ctx->includes = NULL;
   ctx->search_level = 0;
+  ctx->serial = 0;
+  ctx->unit = NULL;
+  ctx->cache_dir = NULL;
+  ctx->peep_n    = 0;
+  ctx->peep_end  = 0;
+  ctx->shake     = 1;
+  ctx->quot      = 0;
+  ctx->cases     = NULL;
+  ctx->symbols_name = NULL;
+  ctx->profile_name = NULL;
+  ctx->locs      = NULL;
+  ctx->loc_table = NULL;
+  ctx->loc_n     = 0;
+  ctx->loc       = 0;
+  ctx->line_p    = NULL;
+  ctx->line      = 0;
+  memset(ctx->name_filter, 0, sizeof(ctx->name_filter));
 }
 
 Cell build_entrypoint(Context* ctx, Word* entrypoint) {
@@ -1269,7 +3954,7 @@ Cell build_entrypoint(Context* ctx, Word* entrypoint) {
   Cell start = ctx->here;
   PutI(LIT);
   Put(0);
-  Put(entrypoint->inst);
+  PutK(entrypoint->inst, CellCall);
   PutI(HALT);
   return start;
 }
@@ -1308,8 +3993,18 @@ void save_all(Context* ctx) {
   if (!entrypoint) die("No main entrypoint");
 
   /* ----- build entrypoint ----- */
+  ctx->loc   = 0;
   ctx->start = build_entrypoint(ctx, entrypoint);
 
+  /* ----- drop unreachable words and lay out by profile ----- */
+  if (ctx->shake || ctx->profile_name) shake(ctx);
+
+  /* ----- move strings and datafile after code ----- */
+  split_data(ctx);
+
+  /* ----- symbols ----- */
+  if (ctx->symbols_name) save_symbols(ctx);
+
   /* ----- prepare heap area ----- */
   ctx->here = align(ctx->here);
   Cell code_size = ctx->here;
@@ -1338,6 +4033,7 @@ void free_all(Context* ctx) {
 
 void set_default_opts(SolOption* opts) {
   opts->use_corelib = 1;
+  opts->snapshot    = NULL;
 }
 
 void usage() {
@@ -1347,12 +4043,17 @@ void usage() {
 
 int handle_opts(SolOption* opts, Context* ctx, int argc, char* argv[]) {
   // returns start index of rest arguments(optind)
-  const char* optstr = "hn";
+  const char* optstr = "hnac:s:m:p:";
   
   struct option long_opts[] =
-    { { "help",       no_argument, NULL, 'h' },
-      { "no-corelib", no_argument, NULL, 'n' },
-      { NULL,         0,           0,    0   }
+    { { "help",       no_argument,       NULL, 'h' },
+      { "no-corelib", no_argument,       NULL, 'n' },
+      { "all-words",  no_argument,       NULL, 'a' },
+      { "cache",      required_argument, NULL, 'c' },
+      { "snapshot",   required_argument, NULL, 's' },
+      { "symbols",    required_argument, NULL, 'm' },
+      { "profile",    required_argument, NULL, 'p' },
+      { NULL,         0,                 0,    0   }
     };
   
   opterr = 0; // disable logging error
@@ -1367,6 +4068,21 @@ int handle_opts(SolOption* opts, Context* ctx, int argc, char* argv[]) {
     case 'n':
       opts->use_corelib = 0;
       break;
+    case 'a':
+      ctx->shake = 0;
+      break;
+    case 'c':
+      ctx->cache_dir = optarg;
+      break;
+    case 's':
+      opts->snapshot = optarg;
+      break;
+    case 'm':
+      enable_symbols(ctx, optarg);
+      break;
+    case 'p':
+      ctx->profile_name = optarg;
+      break;
     case '?':
       fprintf(stderr, "Unknown option: %c\n", optopt);
       usage();
@@ -1390,6 +4106,17 @@ int main(int argc, char* argv[]) {
   int restc   = argc - argi;
   int image_i = argc - 1; // last argument
 
+  // snapshot of core library only
+  if (opts.snapshot) {
+    if (!opts.use_corelib || restc > 0) usage();
+    add_corelib(&ctx);
+    compile_all(&ctx);
+    save_snapshot(&ctx, opts.snapshot);
+    ark_free_vm(ctx.vm);
+    free_dict(ctx.dict);
+    return 0;
+  }
+
   // require at least one source and one image name
   if (restc < 2) usage();
 
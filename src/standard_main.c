@@ -3,12 +3,15 @@
 
 // ===== Error =====
 
+void (*die_hook)(void) = NULL;
+
 void die(char* fmt, ...) {
   va_list ap;
   va_start(ap, fmt);
 
   vfprintf(stderr, fmt, ap);
   fprintf(stderr, "\n");
+  if (die_hook) die_hook();
   exit(1);
 }
 
@@ -305,6 +308,73 @@ void setup_app(VM* vm, int argc, char* argv[]) {
 
 
 
+// ===== Profile =====
+
+/* Calls and tail jumps to each address are counted before each step.
+   Words are named by the symbol file of `sol -m`.
+   The profile has `COUNT NAME` lines of words called at least once
+   and is read by `sol -p` for code layout.
+*/
+
+typedef struct ProfileWord {
+  Cell  begin;
+  char* name;
+} ProfileWord;
+
+static uint64_t*    profile_counts = NULL;
+static ProfileWord* profile_words  = NULL;
+static int          profile_words_n = 0;
+
+void setup_profile(VM* vm, char* symbols_name) {
+  FILE* file = fopen(symbols_name, "r");
+  if (!file) die("ERROR %s : %s", strerror(errno), symbols_name);
+
+  profile_counts = calloc(sizeof(uint64_t), vm->cells);
+  if (!profile_counts) die("Can't allocate profile");
+
+  int  cap = 256;
+  char line[1024];
+  profile_words = calloc(sizeof(ProfileWord), cap);
+  while (profile_words && fgets(line, sizeof(line), file)) {
+    unsigned int begin, end;
+    char name[1024];
+    if (sscanf(line, "word 0x%x 0x%x %1023[^\n]", &begin, &end, name) != 3) continue;
+    if (profile_words_n == cap) {
+      cap *= 2;
+      profile_words = realloc(profile_words, sizeof(ProfileWord) * cap);
+      if (!profile_words) break;
+    }
+    profile_words[profile_words_n++] = (ProfileWord){ .begin = begin, .name = strdup(name) };
+  }
+  if (!profile_words) die("Can't allocate profile");
+  fclose(file);
+}
+
+void profile_step(VM* vm) {
+  if (ark_get(vm, vm->ip) != ARK_OK) return; // step raises
+  Cell v  = vm->result;
+  Cell to = 0;
+  if (v != 0 && !(v & 1)) {
+    to = v; // call
+  } else if (v == ((ARK_INST_JMP << 1) | 1)) {
+    if (ark_get(vm, vm->ip + sizeof(Cell)) != ARK_OK) return;
+    to = vm->result;
+  }
+  if (to != 0 && ark_valid_addr(vm, to)) profile_counts[to / sizeof(Cell)]++;
+}
+
+void save_profile(char* fname) {
+  FILE* file = fopen(fname, "w");
+  if (!file) die("ERROR %s : %s", strerror(errno), fname);
+  for (int i = 0; i < profile_words_n; i++) {
+    uint64_t count = profile_counts[profile_words[i].begin / sizeof(Cell)];
+    if (count > 0) fprintf(file, "%llu %s\n", (unsigned long long)count, profile_words[i].name);
+  }
+  fclose(file);
+}
+
+
+
 // ===== Setup =====
 
 void read_image(VM* vm, char* fname) {
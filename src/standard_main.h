@@ -17,6 +17,7 @@
 
 void die(char* fmt, ...);
 void guard_err(VM* vm, Code code);
+extern void (*die_hook)(void); // called by die before exit (may not return)
 
 
 // ===== Peripheral =====
@@ -44,6 +45,13 @@ void setup_app(VM* vm, int argc, char* argv[]);
 
 
 
+// ===== Profile =====
+
+void setup_profile(VM* vm, char* symbols_name);
+void profile_step(VM* vm);
+void save_profile(char* fname);
+
+
 // ===== Setup =====
 
 void read_image(VM* vm, char* fname);
@@ -835,6 +835,102 @@ void test_run_rp(VM* vm) {
 }
 
 
+// Frame
+
+void test_run_frame(VM* vm) {
+  // (WORD) enter 2 lit 40 lset 0 lit 2 lset 1 lget 0 lget 1 add leave ret
+  // (START) WORD halt => 42
+  Cell word = ARK_ADDR_CODE_BEGIN;
+  Cell here = word;
+  PutI(here, ENTER);
+  Put(here, 2);
+  PutI(here, LIT);
+  Put(here, 40);
+  PutI(here, LSET);
+  Put(here, 0);
+  PutI(here, LIT);
+  Put(here, 2);
+  PutI(here, LSET);
+  Put(here, 1);
+  PutI(here, LGET);
+  Put(here, 0);
+  PutI(here, LGET);
+  Put(here, 1);
+  PutI(here, ADD);
+  PutI(here, LEAVE);
+  PutI(here, RET);
+  Cell start = here;
+  Put(here, word);
+  PutI(here, HALT);
+  Cell rp = vm->rp;
+  Run(start, ARK_HALT);
+  assert(Pop() == 42);
+  assert(vm->rp == rp);
+  assert(vm->fp == 0);
+
+  // enter 4 => failed for rs overflow (return address + fp + 4 locals)
+  here = word;
+  PutI(here, ENTER);
+  Put(here, 4);
+  Run(start, ARK_ERR);
+  assert(vm->err == ARK_ERR_RS_OVERFLOW);
+
+  // lget 1 out of frame => failed for invalid address
+  vm->rp = rp;
+  here = start = ARK_ADDR_CODE_BEGIN;
+  PutI(here, ENTER);
+  Put(here, 1);
+  PutI(here, LGET);
+  Put(here, 1);
+  Run(start, ARK_ERR);
+  assert(vm->err == ARK_ERR_INVALID_ADDR);
+}
+
+
+// Jump table
+
+void test_run_jtbl(VM* vm) {
+  // (A) lit 1 halt (B) lit 2 halt (START) lit i jtbl 2 &A &B lit 3 halt
+  Cell here = ARK_ADDR_CODE_BEGIN;
+  Cell a = here;
+  PutI(here, LIT);
+  Put(here, 1);
+  PutI(here, HALT);
+  Cell b = here;
+  PutI(here, LIT);
+  Put(here, 2);
+  PutI(here, HALT);
+  Cell start = here;
+  PutI(here, LIT);
+  Cell i = here;
+  Put(here, 0);
+  PutI(here, JTBL);
+  Put(here, 2);
+  Put(here, a);
+  Put(here, b);
+  PutI(here, LIT);
+  Put(here, 3);
+  PutI(here, HALT);
+
+  Cell cases[][2] = { {0, 1}, {1, 2}, {2, 3}, {-1, 3} };
+  for (int c = 0; c < 4; c++) {
+    Set(i, cases[c][0]);
+    Run(start, ARK_HALT);
+    assert(Pop() == cases[c][1]);
+  }
+
+  // jtbl 1 -1 => failed for invalid address
+  here = start = ARK_ADDR_CODE_BEGIN;
+  PutI(here, LIT);
+  Put(here, 0);
+  PutI(here, JTBL);
+  Put(here, 1);
+  Put(here, -1);
+  Run(start, ARK_ERR);
+  assert(vm->err == ARK_ERR_INVALID_ADDR);
+}
+
+
 #define do_test(name) {                                                    \
   printf("test %30s ...", #name);                                          \
   Opts opts = { .memory_cells = 4, .dstack_cells = 4, .rstack_cells = 4 }; \
@@ -897,5 +993,9 @@ int main(int argc, char* argv[]) {
   // Registers
   do_run_test(sp);
   do_run_test(rp);
+  // Frame
+  do_run_test(frame);
+  // Jump table
+  do_run_test(jtbl);
   return 0;
 }
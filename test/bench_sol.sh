@@ -0,0 +1,37 @@
+#!/bin/bash
+# Compile speed of sol for a large generated source
+# usage: test/bench_sol.sh [WORDS]
+
+PROJ=$(cd $(dirname $0)/..; pwd)
+SOL=$PROJ/bin/sol
+WORDS=${1:-8000}
+SRC=out/bench.sol
+
+cd $PROJ
+
+# each word has a comment, literals, strings and calls to the previous words
+awk -v n=$WORDS 'BEGIN {
+  doc = "generated words are documented with a long comment line like this one"
+  for (i = 0; i < n; i++) {
+    printf "( ----- generated word %d ----- )\n", i
+    printf "# %s\n# %s\n", doc, doc
+    printf ": w%d ( n -- n )\n", i
+    printf "  dup 1 + swap 2 * over - 3 bit-and + \"w%d\" drop\n", i
+    if (i > 0) printf "  w%d\n", i - 1
+    if (i > 1) printf "  dup IF w%d END\n", i - 2
+    printf ";\n\n"
+  }
+  printf ": main %d w%d drop ;\n", 0, n - 1
+}' > $SRC
+
+SIZE=$(wc -c < $SRC)
+echo "source: $SRC $WORDS words $SIZE bytes"
+
+START=$(date +%s.%N)
+$SOL --all-words $SRC out/bench.img || exit 1
+END=$(date +%s.%N)
+
+echo "$END $START $SIZE" | awk '{
+  t = $1 - $2
+  printf "sol: %.3f sec %.1f MB/s\n", t, $3 / t / 1000000
+}'
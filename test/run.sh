@@ -38,6 +38,11 @@ do
   check_sol "--no-corelib" 42 $src
 done
 
+for src in test/sol_ret42/comptime*.sol
+do
+  check_sol "--no-corelib -a" 42 $src
+done
+
 
 echo "# ===== sol err ====="
 
@@ -80,3 +85,120 @@ for src in test/sol_corelib/*.sol
 do
   check_sol "" 0 "$TESTER $src"
 done
+
+
+echo "===== sol cache ====="
+
+CACHE=out/test_cache
+rm -rf $CACHE
+
+check_cache () {
+  SRC="$1"
+
+  echo -n "$SRC "
+  $SOL $SRC out/nocache.img || exit 1
+  for i in 1 2; do
+    $SOL -c $CACHE $SRC out/cache.img || exit 1
+    if ! cmp -s out/nocache.img out/cache.img; then
+      echo "ng image differs (run $i)"
+      exit 1
+    fi
+  done
+  echo "ok"
+}
+
+for src in tools/*.sol example/hello_sarkam.sol example/rand_fm_beat.sol
+do
+  check_cache $src
+done
+
+for src in test/sol_cache/prim.sol test/sol_cache/shadow.sol test/sol_cache/prim.sol
+do
+  check_sol "--no-corelib -c $CACHE" 42 $src
+done
+
+
+echo "===== sol core snapshot ====="
+
+STAGE0=./out/sol_stage0
+
+check_snapshot () {
+  SRC="$1"
+
+  echo -n "$SRC "
+  $STAGE0 $SRC out/stage0.img || exit 1
+  $SOL $SRC out/snapshot.img || exit 1
+  if ! cmp -s out/stage0.img out/snapshot.img; then
+    echo "ng image differs"
+    exit 1
+  fi
+  echo "ok"
+}
+
+for src in tools/*.sol example/hello_sarkam.sol example/rand_fm_beat.sol
+do
+  check_snapshot $src
+done
+
+for src in test/sol_corelib/*.sol
+do
+  check_snapshot "$TESTER $src"
+done
+
+
+echo "===== sol symbols ====="
+
+SYMBOLS=out/symbols.txt
+
+check_symbols () {
+  SRC="$1"
+  PATTERN="$2"
+
+  echo -n "$SRC $PATTERN "
+  $SOL -m $SYMBOLS $SRC out/tmp.img || exit 1
+  $SOL $SRC out/nosymbols.img || exit 1
+  if ! cmp -s out/tmp.img out/nosymbols.img; then
+    echo "ng image differs"
+    exit 1
+  fi
+  if ! grep -qE "$PATTERN" $SYMBOLS; then
+    echo "ng not found"
+    exit 1
+  fi
+  echo "ok"
+}
+
+check_symbols "$TESTER test/sol_corelib/locals.sol" "^word 0x[0-9a-f]{8} 0x[0-9a-f]{8} ecs:new:find$"
+check_symbols "$TESTER test/sol_corelib/locals.sol" "^line 0x[0-9a-f]{8} 8 test/sol_corelib/locals.sol$"
+check_symbols "$TESTER test/sol_corelib/inline_quot.sol" "^line 0x[0-9a-f]{8} 24 test/sol_corelib/inline_quot.sol$"
+
+
+echo "===== sol profile ====="
+
+check_profile () {
+  SRC="$1"
+
+  echo -n "$SRC "
+  $SOL -m out/profile.sym $SRC out/tmp.img || exit 1
+  $ARKAM -p out/profile.txt -m out/profile.sym out/tmp.img
+  EXPECT="$?"
+  $SOL -p out/profile.txt -m out/profile2.sym $SRC out/profile.img || exit 1
+  $ARKAM out/profile.img
+  ACTUAL="$?"
+  if [ "$ACTUAL" != "$EXPECT" ]; then
+    echo "ng expected $EXPECT but actual $ACTUAL"
+    exit 1
+  fi
+
+  # the hottest word comes first of words
+  HOT=$(sort -nr out/profile.txt | head -1 | cut -d' ' -f2)
+  FIRST=$(grep '^word' out/profile2.sym | sort | head -1 | cut -d' ' -f4)
+  if [ "$HOT" != "$FIRST" ]; then
+    echo "ng $HOT is not first ($FIRST)"
+    exit 1
+  fi
+  echo "ok"
+}
+
+check_profile "$TESTER test/sol_corelib/locals.sol"
+check_profile "--no-corelib test/sol_ret42/loop.sol"
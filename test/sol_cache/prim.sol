@@ -0,0 +1,3 @@
+include: "twice.sol"
+
+: main 21 twice ;
@@ -0,0 +1,6 @@
+# same unit compiled with prim.sol should not be spliced
+: dup 40 ;
+
+include: "twice.sol"
+
+: main 2 twice ;
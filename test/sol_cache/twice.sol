@@ -0,0 +1 @@
+: twice dup + ;
@@ -0,0 +1,42 @@
+( CASE with dense keys is compiled to a jump table )
+
+const: KEY 7
+
+
+: dense ( n -- m )
+  CASE
+    0 OF 10 ENDOF
+    1 OF 11 ENDOF
+    3 OF 13 ENDOF
+    -1 OF 9 ENDOF
+    ( default ) dup 100 + swap
+  ENDCASE ;
+
+: sparse ( n -- m )
+  CASE
+    1000 OF 1 ENDOF
+    -50  OF 2 ENDOF
+    KEY  OF 3 ENDOF
+    drop 0 ( default leaves the selector for ENDCASE ) dup
+  ENDCASE ;
+
+: nested ( a b -- m )
+  swap CASE
+    0 OF CASE 0 OF 1 ENDOF 1 OF 2 ENDOF 0 swap ENDCASE ENDOF
+    1 OF drop 3 RET ENDOF
+    2drop 4 0
+  ENDCASE 10 + ;
+
+: framed ( n -- m ) local: x
+  x! x CASE 2 OF x 21 * ENDOF drop 0 0 ENDCASE ;
+
+
+: main
+  "case dense"   [ 0 dense 10 = 1 dense 11 = bit-and 3 dense 13 = bit-and ] CHECK
+  "case hole"    [ 2 dense 102 = ] CHECK
+  "case range"   [ -1 dense 9 = -2 dense 98 = bit-and 4 dense 104 = bit-and ] CHECK
+  "case sparse"  [ 1000 sparse 1 = -50 sparse 2 = bit-and KEY sparse 3 = bit-and ] CHECK
+  "case default" [ 5 sparse 0 = ] CHECK
+  "case nested"  [ 0 1 nested 12 = 1 0 nested 3 = bit-and 2 0 nested 14 = bit-and ] CHECK
+  "case locals"  [ 2 framed 42 = 3 framed 0 = bit-and ] CHECK
+;
@@ -0,0 +1,42 @@
+( literal quotations are inlined into times, for, dip and ;IF )
+
+val: acc
+
+
+: test/times
+  "times"       [ 0 acc! 5 [ acc 3 + acc! ] times acc 15 = ] CHECK
+  "times 0"     [ 0 acc! 0 [ 1 acc! ] times acc 0 = ] CHECK
+  "times nest"  [ 0 acc! 3 [ 4 [ acc inc acc! ] times ] times acc 12 = ] CHECK
+;
+
+
+: test/for
+  "for ret"     [ 0 10 [ dup 2 mod IF drop RET END + ] for 20 = ] CHECK
+  "for quot"    [ 0 4 [ [ 2 * ] call + ] for 12 = ] CHECK
+  "for string"  [ 0 3 [ drop "abc" 1 + b@ + ] for 294 = ] CHECK
+;
+
+
+: test/dip
+  "dip 2"       [ 1 2 3 [ + ] dip 3 = swap 3 = bit-and ] CHECK
+  "dip rstack"  [ 1 2 3 [ >r inc r> ] dip + + 7 = ] CHECK
+  "dip lines"   [ 1 2 3 [
+      +
+    ] dip 3 = swap 3 = bit-and ] CHECK
+;
+
+
+: test/;IF
+  : pick ( n -- m ) dup 0 < [ drop 1 ] ;IF dup 0 = [ drop 2 ] ;IF drop 3 ;
+  : framed ( n -- m ) local: n  n! n 0 < [ 0 n - ] ;IF n 2 * ;
+  ";IF"         [ -1 pick 1 = 0 pick 2 = bit-and 5 pick 3 = bit-and ] CHECK
+  ";IF locals"  [ -21 framed 21 = 21 framed 42 = bit-and ] CHECK
+;
+
+
+: main
+  test/times
+  test/for
+  test/dip
+  test/;IF
+;
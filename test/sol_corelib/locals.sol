@@ -0,0 +1,50 @@
+include: "entity.sol"
+
+( locals live in the frame of each call )
+
+: test/local
+  : add3 ( a b c -- a+b+c ) local: a  local: b  local: c
+    c! b! a! a b + c + ;
+  : fib ( n -- f ) local: n
+    n! n 2 < IF n RET END
+    n 1 - RECUR n 2 - RECUR + ;
+  : count ( n -- 1+..+n ) local: acc
+    : step ( n -- n-1 ) dup acc + acc! 1 - ; ( nested word shares the frame )
+    dup IF step AGAIN END drop acc ;
+  : in-quot ( n -- n ) local: x  x! [ x 2 * ] call ;
+  : twice ( n -- 2n ) local: x
+    : get x ;
+    : get2 get get + ; ( sibling without locals shares the frame too )
+    x! get2 ;
+  "local add"       [ 1 2 3 add3 6 = ] CHECK
+  "local recursion" [ 20 fib 6765 = ] CHECK
+  "local nested"    [ 10 count 55 = ] CHECK
+  "local quotation" [ 21 in-quot 42 = ] CHECK
+  "local sibling"   [ 21 twice 42 = ] CHECK
+  "local rstack"    [ rp 3 fib drop rp = ] CHECK
+;
+
+
+: test/ecs
+  : es 3 ecs:entities ;
+  "ecs new" [
+    es dup ecs:new! swap dup ecs:new! swap dup ecs:new! swap ecs:new
+    >r 2 = swap 1 = bit-and swap 0 = bit-and r> bit-and
+  ] CHECK
+  "ecs find" [
+    es ecs:components
+    dup >r 10 0 r> ecs:set
+    dup >r 20 1 r> ecs:set
+    dup 20 swap ecs:find drop 1 = swap
+    30 swap ecs:find not bit-and
+  ] CHECK
+;
+
+
+: main
+  "all" [
+    test/local
+    test/ecs
+    ok
+  ] CHECK
+;
@@ -0,0 +1,39 @@
+( words looking at the return stack should work in tail position )
+
+: test/;IF
+  : pick ( ? -- v ) 2 swap [ drop 0 ] ;IF ;
+  : wrap ( ? -- v ) pick ;
+  "tail ;IF 1" [ yes wrap 0 = ] CHECK
+  "tail ;IF 2" [ no  wrap 2 = ] CHECK
+;
+
+
+: test/;EQ
+  : pick ( v -- v ) 1 ;EQ drop no ;
+  : wrap ( v -- v ) pick ;
+  "tail ;EQ 1" [ 1 wrap ] CHECK
+  "tail ;EQ 2" [ 2 wrap not ] CHECK
+;
+
+
+: test/i
+  : wrap ( -- v ) i ; ( should be the return address into quotation )
+  "tail i" [ 42 >r wrap 42 != rdrop ] CHECK
+;
+
+
+: test/recur
+  : down ( n -- 0 ) dup IF 1 - RECUR END ;
+  "tail recur" [ 10000 down 0 = ] CHECK
+;
+
+
+: main
+  "all" [
+    test/;IF
+    test/;EQ
+    test/i
+    test/recur
+    ok
+  ] CHECK
+;
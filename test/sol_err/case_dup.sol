@@ -0,0 +1,3 @@
+( keys of CASE should be unique )
+: foo CASE 1 OF 2 ENDOF 1 OF 3 ENDOF ENDCASE ;
+: main 1 foo ;
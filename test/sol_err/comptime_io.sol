@@ -0,0 +1,4 @@
+( only sys and stdio are available at compile time )
+: open ( -- ) 0 8 io ;
+const: X open
+: main X ;
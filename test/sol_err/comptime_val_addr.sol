@@ -0,0 +1,5 @@
+( a val lives on scratch cells at compile time )
+val: v
+: addr ( -- a ) &v ;
+const: VA addr
+: main VA @ ;
@@ -0,0 +1,3 @@
+inline: swap-r >r swap r> ;
+
+: main 1 2 3 swap-r ;
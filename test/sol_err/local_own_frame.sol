@@ -0,0 +1,5 @@
+( a nested word with its own locals can't access locals of its parent )
+: foo local: x
+  : bar local: y x y! ;
+  bar ;
+: main foo ;
@@ -0,0 +1,4 @@
+( words popping the return address can't be used with locals )
+: ;IF ( ? q -- ) swap IF rdrop >r RET END drop ;
+: foo local: x [ 1 ] ;IF 2 ;
+: main 0 foo ;
@@ -0,0 +1,6 @@
+( a nested word using locals of its parent can't be called from a sibling with locals )
+: outer local: a
+  : e a 1 + 1 - ;
+  : inner local: b 5 b! e ;
+  42 a! inner ;
+: main outer ;
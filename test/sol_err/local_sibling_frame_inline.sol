@@ -0,0 +1,6 @@
+( nor inlined into it )
+: outer local: a
+  : e a ;
+  : inner local: b 5 b! e ;
+  42 a! inner ;
+: main outer ;
@@ -0,0 +1,13 @@
+( const: and data: run words at compile time )
+
+val: n
+
+: six ( -- 6 ) 1 2 + n! n 2 * ;
+const: SIX six
+
+: here ( -- addr ) 8 @ ;
+: b, ( b -- ) here b! here 1 + 8 ! ;
+: table ( -- ) SIX b, SIX b, 30 b, ;
+data: tbl table
+
+: main tbl 1 + b@ tbl 2 + b@ + n + SIX + ; ( 6 + 30 + 0 + 6 )
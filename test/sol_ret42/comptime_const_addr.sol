@@ -0,0 +1,7 @@
+( const: keeps a word address taken at compile time )
+
+: forty2 42 ;
+: addr ( -- a ) &forty2 ;
+const: F addr
+
+: main F >r ;
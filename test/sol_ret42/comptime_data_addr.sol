@@ -0,0 +1,11 @@
+( data: keeps word addresses stored at compile time )
+
+: seven  7 ;
+: forty2 42 ;
+
+: here ( -- addr ) 8 @ ;
+: , ( v -- ) here ! here 4 + 8 ! ;
+: table ( -- ) &seven , &forty2 , ;
+data: tbl table
+
+: main tbl 4 + @ >r ;
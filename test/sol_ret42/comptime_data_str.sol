@@ -0,0 +1,8 @@
+( data: keeps string pointers stored at compile time )
+
+: here ( -- addr ) 8 @ ;
+: , ( v -- ) here ! here 4 + 8 ! ;
+: table ( -- ) "seven" , "*" , ;
+data: tbl table
+
+: main tbl 4 + @ b@ ; # ascii code 42
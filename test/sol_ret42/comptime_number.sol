@@ -0,0 +1,8 @@
+( a number equal to a word address is not relocated )
+
+: s "hello world" ;
+: t 1 ;
+: v 48 ;
+const: N v
+
+: main N -6 + ;
@@ -0,0 +1,16 @@
+( strings and datafile are put after code, identical strings only once )
+
+datafile: star "shake.dat" ( contains "*" )
+
+: s1 "forty-two" ;
+: s2 "forty-two" ;
+: code-end ( -- addr ) 0 ;
+
+: main
+  s1 s2 = IF
+    star &code-end > IF
+      s2 &code-end > IF star 4 + b@ HALT END
+    END
+  END
+  0
+;
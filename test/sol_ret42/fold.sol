@@ -0,0 +1,18 @@
+( constant folding and peephole should keep results )
+
+const: W 20
+
+: two-w ( -- 40 ) W 2 * ;
+: pick ( ? -- n ) IF 40 ELSE 0 END 2 + ; ( not folded over END )
+: nonzero ( n -- ? ) 0 = 0 = ;
+: clean ( n -- n ) 7 drop swap swap 1 * 0 + ;
+
+: main
+  -1 pick 42 != IF 1 RET END
+   0 pick  2 != IF 2 RET END
+   3 nonzero 0 = IF 3 RET END
+   0 nonzero     IF 4 RET END
+   1 2 clean 2 != IF 5 RET END 1 != IF 8 RET END
+   7 3 /mod 1 != IF 6 RET END 2 != IF 7 RET END
+   two-w 2 +
+;
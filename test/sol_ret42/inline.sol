@@ -0,0 +1,14 @@
+( small words and inline: words are copied to callers )
+
+: inc 1 + ;
+inline: add20 10 + 10 + 10 + 10 + -20 + ;
+
+val: x
+
+: bump x inc x! ;
+
+: main
+  1 add20 x!
+  bump bump
+  &x @ inc 18 +
+;
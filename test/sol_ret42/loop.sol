@@ -0,0 +1,16 @@
+( DO/LOOP, BEGIN/WHILE/REPEAT and BEGIN/UNTIL are compiled inline )
+
+: sum ( n -- 0+..+n-1 ) 0 swap DO I + LOOP ;
+: outer ( -- 0+0+1+1+2+2 ) 0 3 DO 2 DO J + LOOP LOOP ;
+: never ( n -- 0 ) 0 swap DO 1 + LOOP ;
+: down ( n -- 0 ) BEGIN dup WHILE 1 - REPEAT ;
+: up ( -- 5 ) 0 BEGIN 1 + dup 5 = UNTIL ;
+
+: main
+  9 sum       ( 36 )
+  outer +     ( 42 )
+  0 never +
+  -1 never +
+  10 down +
+  up 5 - +
+;
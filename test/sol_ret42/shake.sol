@@ -0,0 +1,18 @@
+( unreachable words are dropped and the rest are relocated )
+
+val: v
+datafile: star "shake.dat" ( contains "*" )
+
+: unused1 1 v! "unused" drop ;
+: call ( q -- ) >r ;
+: add ( a b -- c ) + ;
+: unused2 &add v! [ 2 ] ;
+: star@ ( -- c ) star 4 + b@ ;
+: twice ( q -- ) dup >r call r> call ;
+
+: main
+  20 v!
+  [ v 1 + v! ] twice
+  &add v star@ 42 - + swap call ( 22 + 0 )
+  20 +
+;
@@ -0,0 +1,11 @@
+( tail calls should not consume return stack )
+
+: down ( n -- 0 ) dup IF 1 - RECUR END ;
+
+: count ( acc n -- acc )
+  dup IF 1 - swap 1 + swap RECUR RET END drop ;
+
+: main
+  100000 down
+  0 100000 count 99958 - +
+;